@@ -2,9 +2,29 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include "hash-table.h"
-#include "min-heap.h"
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include "PacketLoss.h"
+#include "hash-table.h"
+#include "oos-buffer.h"
+#include "sketch.h"
+#include "top-k.h"
+#include "packet-batch.h"
+#include "offline.h"
+#include "metrics.h"
+#include "schema.h"
+#include "filter.h"
+#include "trace-reader.h"
+#include "packet-reader.h"
+#include "diff.h"
+#include "fleet.h"
+#include "out-buffer.h"
+#include "report-records.h"
+#include "radix-sort.h"
+#include "index.h"
 
 
 /**
@@ -26,6 +46,19 @@ uint64_t makeID(struct connection currConnection) {
 	return connID;
 }
 
+/**
+ * Function for converting a dotted IP address to its 32-bit value.
+ */
+unsigned long parseIP(const char* ip) {
+	unsigned long ipLong = 0L;
+	for (int ctr = 0; ctr < 4; ctr++) {
+		ipLong += atol(ip) << ((3 - ctr) * 8);
+		while (*ip != '.' && *ip != 0) ip++;
+		if (*ip == '.') ip++;
+	}
+	return ipLong;
+}
+
 /**
  * Function for reverting the connection ID to a string.
  */	
@@ -42,114 +75,343 @@ void IDToString(char *str, uint64_t connID) {
 }
 
 /**
- * Function for handling out of sequence packets from the trace stream. 
- */	
-void storeOOSPacket(oOS_ht_hash_table* oOSHT, struct packet currPacket) {
-	struct packet* pkt = calloc(1, sizeof(struct packet));
-	pkt->seqNum = currPacket.seqNum;
-	pkt->timeStamp = currPacket.timeStamp;
-	if (currPacket.timeStamp == 0) {puts("Error: Bad packet and invalid timestamp!");exit(0);}
-	pkt->payloadSize = currPacket.payloadSize;
-	pkt->syn = currPacket.syn;
-	pkt->fin = currPacket.fin;
-	pkt->connID = currPacket.connID;
-	// If connection is not already in oOS buffer, initialize heap and add key(connID) and value(heap):
-	if (oOS_ht_search(oOSHT, currPacket.connID) == 0) {
-		struct heap* heap = calloc(1, sizeof(struct heap));
-		heap_init(heap);
-		heap_push(heap, pkt);
-		oOS_ht_insert(oOSHT, currPacket.connID, heap);
-	// If connection already in oOS buffer
-	} else if (oOS_ht_search(oOSHT, currPacket.connID) != 0) {
-		struct heap* h = oOS_ht_search(oOSHT, currPacket.connID);
-		heap_push(h, pkt);
-		//printf("top of heap is seqNum %d\n", heap_front(h)->seqNum);
-	}
+ * Function for naming the report of a trace: the trace name without its .gz and file extension (stdin for a trace
+ * read from standard input, a pipe or a device, whose report cannot go beside it), followed by the suffix. The name
+ * is allocated, so that paths of any length fit.
+ */
+char* outputName(const char* filename, const char* suffix) {
+	struct stat info;
+	if (strcmp(filename, "-") == 0) filename = "stdin"; // Trace read from standard input
+	else if (stat(filename, &info) == 0 && (S_ISFIFO(info.st_mode) || S_ISCHR(info.st_mode) || S_ISSOCK(info.st_mode)))
+		filename = "stdin"; // Such as /dev/fd/63 of a process substitution
+	size_t len = strlen(filename);
+	char* name = malloc(len + strlen(suffix) + 1);
+	if (!name) _exit(1); // Exit if the memory allocation fails
+	memcpy(name, filename, len + 1);
+	while (len > 1 && name[len - 1] == '/') name[--len] = 0; // Directory given with a trailing slash
+	if (len > 3 && strcmp(name + len - 3, ".gz") == 0) name[len -= 3] = 0; //delete the .gz suffix
+	char* base = strrchr(name, '/');
+	base = base != NULL ? base + 1 : name;
+	char* extension = strrchr(base, '.');
+	if (extension != NULL && extension != base) *extension = 0; //delete the .txt suffix
+	strcat(name, suffix);
+	return name;
+}
+
+/**
+ * Function for checking that a packet kept by the exact analysis has a time stamp. Returns 1 for a bad packet,
+ * whose trace then cannot be analysed.
+ */
+int badTimeStamp(struct packet currPacket) {
+	if (currPacket.timeStamp != 0) return 0;
+	puts("Error: Bad packet and invalid timestamp!");
+	return 1;
+}
+
+/**
+ * Function for making the compact buffer record of an out of sequence packet.
+ */
+struct oosRecord makeOOSRecord(struct packet currPacket) {
+	return (struct oosRecord){
+		.seqNum = (uint32_t) currPacket.seqNum,
+		.payloadSize = (uint16_t) currPacket.payloadSize,
+		.flags = (uint16_t) ((currPacket.fin ? OOS_FIN : 0) | (currPacket.syn ? OOS_SYN : 0)),
+		.timeStamp = currPacket.timeStamp
+	};
 }
 
 /**
  * Function for updating the sequence number by checking the out-of-sequence packets buffer. 
  */	
-int updateSeqNumsFromBuffer(ht_hash_table* connHT, oOS_ht_hash_table* oOSHT, struct packet currPacket) {
-	struct heap* connOOSHeap = oOS_ht_search(oOSHT, currPacket.connID);
+int updateSeqNumsFromBuffer(ht_hash_table* connHT, struct connStatus* conn) {
+	struct oosPool* pool = connHT->oosPool;
 	int connClosed = 0;
-	if (connOOSHeap != 0) {
-		struct packet* nextOOSPacket = heap_front(connOOSHeap);
+	if (oos_count(pool, conn)) {
+		struct oosRecord* nextOOSPacket = oos_front(pool, conn);
 		unsigned long nextOOSSeqNum = nextOOSPacket->seqNum;
 		unsigned long prevOOSSeqNum;
-		while(nextOOSSeqNum == ht_search(connHT, currPacket.connID)->seqNum && connOOSHeap->count) { // If the buffer contains the next packet
-			ht_search(connHT, currPacket.connID)->seqNum = nextOOSSeqNum + nextOOSPacket->payloadSize + nextOOSPacket->fin;
-			ht_search(connHT, currPacket.connID)->timeStamp = nextOOSPacket->timeStamp;
-			if (nextOOSPacket->fin)	connClosed = 1; // If the sequenced packet from the buffer is FIN, close the connection
-			//printf("updateSeqNumsFromBuffer() assigned new seqNum %d at time %.3f!\n", 
-			//		nextOOSSeqNum + nextOOSPacket->payloadSize + nextOOSPacket->fin, currPacket.timeStamp);
+		while(nextOOSSeqNum == conn->seqNum && oos_count(pool, conn)) { // If the buffer contains the next packet
+			int fin = (nextOOSPacket->flags & OOS_FIN) != 0;
+			oos_advance(pool, conn, nextOOSSeqNum + nextOOSPacket->payloadSize + fin);
+			conn->timeStamp = ht_time_offset(connHT, nextOOSPacket->timeStamp);
+			if (fin) connClosed = 1; // If the sequenced packet from the buffer is FIN, close the connection
 			do {
-				heap_pop(connOOSHeap);
-				if (connOOSHeap->count == 0) break;
+				oos_pop(pool, conn);
+				if (oos_count(pool, conn) == 0) break;
 				prevOOSSeqNum = nextOOSSeqNum;
-				nextOOSPacket = heap_front(connOOSHeap);
+				nextOOSPacket = oos_front(pool, conn);
 				nextOOSSeqNum = nextOOSPacket->seqNum;
-				//printf("prevOOSSeqNum: %d\nnextOOSSeqNum: %d\n", prevOOSSeqNum, nextOOSSeqNum);
 			} while (prevOOSSeqNum == nextOOSSeqNum); // Check for duplicate packets in buffer and remove
 		}
-		// Clean up and delete the OOS buffer if no more OOS packets or connection closed
-		if (connClosed || oOS_ht_search(oOSHT, currPacket.connID)->count == 0) {
-			// If connection closed or buffer is empty, remove the OOS buffer
-			oOS_ht_delete(oOSHT, currPacket.connID);
-			//puts("after oOS delete");
-		}
-		
 	} 
 	return connClosed;
 }
 
 /**
- * Function for updating the linked list of closed connections. 
+ * Function for collating the gaps of a connection from its out-of-sequence packet buffer. Empties the buffer.
+ */
+void collateGaps(struct oosPool* pool, struct connStatus* conn, struct connReport* report) {
+	unsigned long lastSeqNum = report->seqNum;
+	struct oosRecord* nextOOSPacket;
+	while (oos_count(pool, conn) != 0) {
+		nextOOSPacket = oos_front(pool, conn);
+		if (lastSeqNum != nextOOSPacket->seqNum)
+			report_add_gap(report, lastSeqNum, nextOOSPacket->seqNum, nextOOSPacket->timeStamp);
+		lastSeqNum = nextOOSPacket->seqNum + nextOOSPacket->payloadSize;
+		oos_pop(pool, conn);
+	}
+}
+
+/**
+ * Function for recording a closed connection. Only the count of closed connections is kept for the summary; the
+ * connection itself is deleted by reapClosedConns() once it has lingered for CLOSE_LINGER. Records left in its buffer
+ * (only possible past its FIN, as it closes once the FIN is in sequence) are collated into the closed totals, and the
+ * connection is offered to the top K if that leaves it with bytes missing. The buffer is then empty.
  */	
-void updateClosedConns(struct node** head, uint64_t connID) {
-	struct node* newNode = calloc(1, sizeof(struct node));
-	newNode->connID = connID;
-	newNode->next = *head;
-	*head = newNode;
+void closeConn(ht_hash_table* connHT, struct closedConns* closed, uint64_t connID, double timeStamp) {
+	struct connStatus* conn = ht_search(connHT, connID);
+	if (conn != NULL && oos_count(connHT->oosPool, conn)) {
+		struct connReport report = {.connID = connID, .seqNum = conn->seqNum, .timeStamp = ht_time(connHT, conn), .closed = 1};
+		collateGaps(connHT->oosPool, conn, &report);
+		if (report.bytesMissing) {
+			closed->lossyCt++;
+			closed->missingBytes += report.bytesMissing;
+			closed->gapCt += report.gapCt;
+		}
+		if (closed->top != NULL && report.bytesMissing)
+			topconns_offer(closed->top, &report);
+		else
+			free(report.gaps);
+	}
+	if (closed->count == closed->size) {
+		unsigned int oldSize = closed->size;
+		closed->size = oldSize ? oldSize << 1 : 1024;
+		closed->data = realloc(closed->data, sizeof(struct closedConn) * closed->size);
+		if (!closed->data) _exit(1); // Exit if the memory allocation fails
+		// Unwrap the ring into the new space
+		for (unsigned int i = 0; i < closed->head; i++)
+			closed->data[oldSize + i] = closed->data[i];
+	}
+	closed->data[(closed->head + closed->count++) % closed->size] = (struct closedConn){connID, timeStamp};
+	closed->total++;
+}
+
+// Returns the first slot to probe for a connection in the set of deleted connections
+#define reapedSlot(closed, connID) ((unsigned int) (((connID) * 0x9E3779B97F4A7C15UL) >> 32) & ((closed)->reapedSize - 1))
+
+/**
+ * Function for checking whether a connection was deleted after closing, so that its packets are ignored.
+ */	
+int isReapedConn(const struct closedConns* closed, uint64_t connID) {
+	if (closed->reapedCt == 0) return 0;
+	for (unsigned int i = reapedSlot(closed, connID); closed->reaped[i]; i = (i + 1) & (closed->reapedSize - 1))
+		if (closed->reaped[i] == connID) return 1;
+	return 0;
+}
+
+/**
+ * Function for adding a deleted connection to the set of deleted connections, doubling the set when half full.
+ */	
+void addReapedConn(struct closedConns* closed, uint64_t connID) {
+	if ((closed->reapedCt + 1) * 2 > closed->reapedSize) {
+		uint64_t* old = closed->reaped;
+		unsigned int oldSize = closed->reapedSize;
+		closed->reapedSize = oldSize ? oldSize << 1 : 1024;
+		closed->reaped = calloc(closed->reapedSize, sizeof(uint64_t));
+		if (!closed->reaped) _exit(1); // Exit if the memory allocation fails
+		closed->reapedCt = 0;
+		for (unsigned int i = 0; i < oldSize; i++)
+			if (old[i]) addReapedConn(closed, old[i]);
+		free(old);
+	}
+	unsigned int i = reapedSlot(closed, connID);
+	while (closed->reaped[i] && closed->reaped[i] != connID)
+		i = (i + 1) & (closed->reapedSize - 1);
+	if (!closed->reaped[i]) closed->reapedCt++;
+	closed->reaped[i] = connID;
+}
+
+/**
+ * Function for deleting the connections which closed more than CLOSE_LINGER before the given time, freeing their
+ * slots in the connection table for reuse. Their IDs are kept in the set of deleted connections.
+ */	
+void reapClosedConns(ht_hash_table* connHT, struct closedConns* closed, double timeStamp) {
+	while (closed->count && closed->data[closed->head].timeStamp < timeStamp - CLOSE_LINGER) {
+		ht_delete(connHT, closed->data[closed->head].connID);
+		addReapedConn(closed, closed->data[closed->head].connID);
+		closed->head = (closed->head + 1) % closed->size;
+		closed->count--;
+	}
+}
+
+/**
+ * Function for stamping the detection of a gap: the packet which opened it, and the time it was noticed (on the
+ * monotonic clock, which trace-replay shares). Written as
+ * gap CONNECTION TRACE_TIME EXPECTED_SEQ_NUM SEQ_NUM DETECTION_NS
+ */
+void detectGap(FILE* events, struct connStatus* conn, struct packet currPacket) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	fprintf(events, "gap %016lx %.9f %u %lu %lld\n", (unsigned long) currPacket.connID, currPacket.timeStamp, conn->seqNum,
+			currPacket.seqNum, (long long) now.tv_sec * 1000000000LL + now.tv_nsec);
 }
 
 /**
  * Function for updating the seq numbers of connections open. If out of sequence, packet is stored in array.
- * If closing the connection, connection is recorded in closed connections list and connection and associated outOfSeq packets are deleted
+ * If closing the connection, 1 is returned so the caller records it with closeConn(), which empties its outOfSeq buffer.
+ * Returns -1 for a bad packet, which ends the analysis of the trace.
+ * Packets of a connection which has closed are ignored, whether it is still lingering or was deleted since.
+ * Gaps opening are stamped in events, unless it is NULL.
  * @param line String array from a line of the trace file
  */	
-int updateSeqNums(ht_hash_table* connHT, oOS_ht_hash_table* oOSHT, struct packet currPacket) {
+int updateSeqNums(ht_hash_table* connHT, const struct closedConns* closed, struct packet currPacket, FILE* events) {
 	int connClosed = 0;
-	printf("Handling packet no. %d at time %.5f of connection %llx\n", currPacket.seqNum, currPacket.timeStamp, currPacket.connID);
+	struct connStatus* conn = ht_search(connHT, currPacket.connID);
 					
-	// If packet is from new connection:
-	if (ht_search(connHT, currPacket.connID) == NULL) {
-		struct connStatus* newConn = calloc(1, sizeof(struct connStatus));
-		ht_insert(connHT, currPacket.connID, newConn);
+	// If connection has closed and was deleted after lingering
+	if (conn == NULL && isReapedConn(closed, currPacket.connID)) {
+		return 0;
+	// Else if packet is from new connection:
+	} else if (conn == NULL) {
+		if (badTimeStamp(currPacket)) return -1;
+		struct connStatus* newConn = ht_insert(connHT, currPacket.connID);
 		newConn->seqNum = 1;
-		newConn->timeStamp = currPacket.timeStamp;
-		if (currPacket.timeStamp == 0) {puts("Error: Bad packet and invalid timestamp!");exit(0);}
-		connClosed = updateSeqNumsFromBuffer(connHT, oOSHT, currPacket);
+		newConn->timeStamp = ht_time_offset(connHT, currPacket.timeStamp);
+	// Else if connection has closed and is lingering
+	} else if (conn->flags & CONN_CLOSED) {
+		return 0;
 	// Else if packet is from open connection and matches next expected sequence number
-	} else if (ht_search(connHT, currPacket.connID)->seqNum == currPacket.seqNum) {
-		ht_search(connHT, currPacket.connID)->seqNum = currPacket.seqNum + currPacket.payloadSize + currPacket.fin;
-		ht_search(connHT, currPacket.connID)->timeStamp = currPacket.timeStamp;
-		connClosed = updateSeqNumsFromBuffer(connHT, oOSHT, currPacket);
-		// If connection closed from current packet, clean up any packets from the OOS buffer
-		if (currPacket.fin) {
-			connClosed = 1;
-			// if (oOS_ht_search(oOSHT, currPacket.connID) != NULL)
-			// 	oOS_ht_delete(oOSHT, currPacket.connID);
-		}
+	} else if (conn->seqNum == currPacket.seqNum) {
+		oos_advance(connHT->oosPool, conn, (uint32_t) (currPacket.seqNum + currPacket.payloadSize + currPacket.fin));
+		conn->timeStamp = ht_time_offset(connHT, currPacket.timeStamp);
+		connClosed = updateSeqNumsFromBuffer(connHT, conn);
+		// If connection closed from current packet, any packets left in the OOS buffer go to closeConn()
+		if (currPacket.fin) connClosed = 1;
+		if (connClosed) conn->flags |= CONN_CLOSED;
 	// Else if packet is out of sequence.
-	} else if (ht_search(connHT, currPacket.connID)->seqNum < currPacket.seqNum) {
+	} else if (conn->seqNum < currPacket.seqNum) {
 		// Store packet in buffer if it has a later sequence number
-		storeOOSPacket(oOSHT, currPacket);
+		if (badTimeStamp(currPacket)) return -1;
+		if (events != NULL && oos_count(connHT->oosPool, conn) == 0)
+			detectGap(events, conn, currPacket);
+		oos_push(connHT->oosPool, conn, makeOOSRecord(currPacket));
 	}
-	//if (ht_search(connHT, (uint64_t) 0x131f4000089bbe)->timeStamp == 0) {puts("Error: Bad packet and invalid timestamp!");exit(0);}
 	return connClosed;
 }
 
+/**
+ * Function for handling a packet of the exact analysis as it is read: deletes the connections which closed long
+ * enough before it, then updates its connection. Returns 1 for a bad packet, else 0.
+ */
+int handlePacket(ht_hash_table* connHT, struct closedConns* closed, struct packet currPacket, FILE* events) {
+	reapClosedConns(connHT, closed, currPacket.timeStamp);
+	int connClosed = updateSeqNums(connHT, closed, currPacket, events);
+	if (connClosed > 0)
+		closeConn(connHT, closed, currPacket.connID, currPacket.timeStamp);
+	return connClosed < 0;
+}
+
+/**
+ * Function for passing a packet to the exact analysis through the lookup window. Its connection's slot is
+ * prefetched now and the packet is handled once LOOKUP_AHEAD more packets have been read, so the lookups of the
+ * packets in the window overlap instead of each stalling on a cache miss. Packets are still handled in trace order.
+ * Returns 1 if the packet handled was bad, else 0.
+ */
+int lookupPacket(struct lookupWindow* w, ht_hash_table* connHT, struct closedConns* closed, struct packet currPacket,
+		FILE* events) {
+	ht_prefetch(connHT, currPacket.connID);
+	if (w->count < LOOKUP_AHEAD) {
+		w->packets[(w->head + w->count++) % LOOKUP_AHEAD] = currPacket;
+		return 0;
+	}
+	int bad = handlePacket(connHT, closed, w->packets[w->head], events);
+	w->packets[w->head] = currPacket;
+	w->head = (w->head + 1) % LOOKUP_AHEAD;
+	return bad;
+}
+
+/**
+ * Function for handling the packets left in the lookup window. Returns 1 if one of them was bad, else 0.
+ */
+int flushLookups(struct lookupWindow* w, ht_hash_table* connHT, struct closedConns* closed, FILE* events) {
+	for (; w->count; w->count--) {
+		if (handlePacket(connHT, closed, w->packets[w->head], events))
+			return 1;
+		w->head = (w->head + 1) % LOOKUP_AHEAD;
+	}
+	return 0;
+}
+
+/**
+ * Function for processing a batch of packets grouped by connection. Each connection's packets are handled in one
+ * run, in trace order, so its entries in the connection tables stay in cache for the whole run. Consecutive out of
+ * sequence packets of a connection are collected and added to its buffer together, before the next packet which
+ * could drain the buffer. Returns 1 if a packet was bad, else 0.
+ */
+int processBatch(struct packetBatch* batch, struct options* opts, ht_hash_table* connHT, struct sketch* sk,
+		struct closedConns* closed, FILE* events) {
+	struct oosRecord pending[64];
+	unsigned int pendingCt = 0;
+	struct connStatus* pendingConn = NULL;
+	// Packets in the batch are no older than its first one, so connections which closed long enough before it can go
+	if (connHT != NULL && batch->count)
+		reapClosedConns(connHT, closed, batch->timeStamp[0]);
+	batch_sort(batch);
+	for (unsigned int i = 0; i < batch->count; i++) {
+		struct packet currPacket = batch_get(batch, i);
+		if (opts->mode == MODE_SKETCH) {
+			sketch_update(sk, currPacket);
+			continue;
+		}
+		// Prefetch the slot of a packet a little further on (within a connection's run, the slot is already cached)
+		if (i + LOOKUP_AHEAD < batch->count)
+			ht_prefetch(connHT, batch->connID[batch->order[i + LOOKUP_AHEAD]]);
+		struct connStatus* conn = ht_search(connHT, currPacket.connID);
+		if (pendingCt && (pendingConn != conn || pendingCt == sizeof pending / sizeof pending[0])) {
+			oos_push_bulk(connHT->oosPool, pendingConn, pending, pendingCt);
+			pendingCt = 0;
+		}
+		if (conn != NULL && !(conn->flags & CONN_CLOSED) && conn->seqNum < currPacket.seqNum) {
+			if (badTimeStamp(currPacket)) return 1;
+			if (events != NULL && pendingCt == 0 && oos_count(connHT->oosPool, conn) == 0)
+				detectGap(events, conn, currPacket);
+			pending[pendingCt++] = makeOOSRecord(currPacket);
+			pendingConn = conn;
+			continue;
+		}
+		if (pendingCt) {
+			oos_push_bulk(connHT->oosPool, pendingConn, pending, pendingCt);
+			pendingCt = 0;
+		}
+		int connClosed = updateSeqNums(connHT, closed, currPacket, events);
+		if (connClosed < 0) return 1;
+		if (connClosed)
+			closeConn(connHT, closed, currPacket.connID, currPacket.timeStamp);
+	}
+	if (pendingCt)
+		oos_push_bulk(connHT->oosPool, pendingConn, pending, pendingCt);
+	batch_clear(batch);
+	return 0;
+}
+
+/**
+ * Function for filling a metrics snapshot from the state of the parse. It is only called when the publisher asks for
+ * a snapshot, and only copies the running totals of the table and the buffer pool, so it costs the same however many
+ * connections are open. Packets still in the lookup window are counted as read but not yet in the buffer totals.
+ */
+void fillMetrics(struct metricsSnapshot* snap, ht_hash_table* connHT, struct closedConns* closed, unsigned long packetCt,
+		unsigned long byteCt, double timeStamp) {
+	*snap = (struct metricsSnapshot){.traceTime = timeStamp, .packets = packetCt, .bytes = byteCt, .openConns = -1};
+	if (connHT == NULL) return;
+	snap->openConns = connHT->count - closed->count;
+	snap->tableLoad = connHT->count / (double) connHT->size;
+	snap->tableFill = (connHT->count + connHT->deleted) / (double) connHT->size;
+	snap->oosRecords = connHT->oosPool->records;
+	snap->oosBytes = connHT->oosPool->bytes;
+	snap->missingBytes = connHT->oosPool->missingBytes;
+	snap->poolLoad = connHT->oosPool->buffers / (double) connHT->oosPool->size;
+}
+
 /**
  * Function for storing information of missing packets over 20s before the end of trace file in a the linked list. 
  */	
@@ -163,119 +425,128 @@ void updateWarningNodes(struct warningNode** warningHead, uint64_t connID, doubl
 }
 
 /**
- * Function for outputting the summary statistics.
+ * Function for printing the open connections and gaps of the opts->topK lossiest connections only. The other
+ * connections are added to aggregate totals, and their warnings are counted instead of listed. The open connections
+ * are merged by a scan of the table into the heap of the parse, which already holds any connections which closed
+ * with gaps (see top-k.h).
  */
-void summary(ht_hash_table* connHT, struct node* head, oOS_ht_hash_table* oOSHT, int packetCt, int byteCt, double lastTimeStamp, const char* outputFilename) {
-	FILE *file;
-	file = fopen(outputFilename, "w");
-	if(file == NULL) {
-      perror("Error opening output file");
-   	}		
-	
-	puts("\nParse finished! Analysing trace statistics...");
-	fputs("======================================================================================\n", file);
-	fprintf(file, "* OUTPUT FROM PACKET LOSS ANALYSIS of %s\n", outputFilename);
-	fputs("======================================================================================\n\n", file);
-	
-	int connCt = 0;
-	int openConnCt = 0;
-	struct warningNode* warningHead = NULL;
-	int over60sWarningFlag = 0;
-
-	// Delete completed connections
-	struct node* nodePtr = head;
-	printf("\nDeleting completed connections... ");
-	while (nodePtr != NULL) {
-		ht_delete(connHT, nodePtr->connID);
-		connCt++;
-		nodePtr = nodePtr->next;
+void summaryTopConns(ht_hash_table* connHT, struct topConns* top, struct options* opts, double lastTimeStamp, FILE* file,
+		struct warningNode** warningHead, int* openConnCt, unsigned long* totalMissingBytes, int* otherWarningCt) {
+	int lossyConnCt = 0;
+	unsigned long gapCt = 0;
+	for (int i = 0; i < connHT->size; i++) {
+		if (!ht_slot_used(&connHT->items[i]) || (connHT->items[i].value.flags & CONN_CLOSED)) continue;
+		struct connStatus* conn = &connHT->items[i].value;
+		struct connReport report = {.connID = connHT->items[i].key, .seqNum = conn->seqNum, .timeStamp = ht_time(connHT, conn)};
+		collateGaps(connHT->oosPool, conn, &report);
+		(*openConnCt)++;
+		*totalMissingBytes += report.bytesMissing;
+		gapCt += report.gapCt;
+		if (report.bytesMissing) lossyConnCt++;
+		if (report.timeStamp < lastTimeStamp - 20) (*otherWarningCt)++;
+		for (unsigned int g = 0; g < report.gapCt; g++)
+			if (report.gaps[g].timeStamp < lastTimeStamp - 20) (*otherWarningCt)++;
+		topconns_offer(top, &report);
 	}
-	puts("Done.\n");
+	topconns_sort(top);
 
-	// Print open connections
-	char ipString[30];
-	puts("\nConnections still open:");
-	fputs("\nConnections still open:\n", file);
-	for (int i = 0; i < connHT->size; i++) {
-		if (connHT->items[i] == NULL || connHT->items[i]->key == 0L) continue;
-		IDToString(ipString, connHT->items[i]->key);
-		printf("%s expecting seq num %d since %.3f\n", 
-				ipString, connHT->items[i]->value->seqNum, connHT->items[i]->value->timeStamp);
-		fprintf(file, "%s expecting seq num %d since %.3f\n", 
-				ipString, connHT->items[i]->value->seqNum, connHT->items[i]->value->timeStamp);
-		if (connHT->items[i]->value->timeStamp < lastTimeStamp - 20)
-			updateWarningNodes(&warningHead, connHT->items[i]->key, connHT->items[i]->value->timeStamp, 0L);
-		connCt++;
-		openConnCt++;
-	}
-	if (openConnCt == 0) {
-		puts("None.");
-		fputs("None.\n", file);
-	}
-
-	// Collate missing packets and print to terminal
-	struct heap* h = calloc(1, sizeof(struct heap));
-	unsigned long lastSeqNum;
-	unsigned long prevSeqNum;
-	unsigned long totalMissingBytes = 0;
-	struct packet* nextOOSPacket = calloc(1, sizeof(struct packet));
-	// printf("oOSHT count: %d\n", oOSHT->count);
-	// printf("oOSHT size: %d\n", oOSHT->size);
-	for (int i = 0; i < oOSHT->size; i++) {
-		if (oOSHT->items[i] == NULL || oOSHT->items[i]->key == 0L) continue;
-		IDToString(ipString, oOSHT->items[i]->key);
-		printf("\nBytes missing from %s: \n", ipString);
-		fprintf(file, "\nBytes missing from %s: \n", ipString);
-		h = oOSHT->items[i]->value;
-		// printf("heap count: %d\n", h->count);
-		// printf("heap size: %d\n", h->size);
-		nextOOSPacket = heap_front(h);
-		// printf("Packet seqnum: %d; Timestamp: %.3f\n", nextOOSPacket->seqNum, nextOOSPacket->timeStamp);
-		// Check expected seqNum
-		lastSeqNum = ht_search(connHT, oOSHT->items[i]->key)->seqNum;
-		while (h->count != 0) {
-			// printf("Last sequence number: %d \n", lastSeqNum);
-			nextOOSPacket = heap_front(h);
-			if (!lastSeqNum) {
-				totalMissingBytes += lastSeqNum;
-				printf("%d missing bytes between start of connection and seq num %d (incl. SYN phantom byte) at time %.3f\n",
-						nextOOSPacket->seqNum, nextOOSPacket->seqNum, nextOOSPacket->timeStamp);
-				fprintf(file, "%d missing bytes between start of connection and seq num %d (incl. SYN phantom byte) at time %.3f\n",
-						nextOOSPacket->seqNum, nextOOSPacket->seqNum, nextOOSPacket->timeStamp);
-				if (nextOOSPacket->timeStamp < lastTimeStamp - 20)
-					updateWarningNodes(&warningHead, oOSHT->items[i]->key, nextOOSPacket->timeStamp, nextOOSPacket->seqNum);			
-			} else if (lastSeqNum != nextOOSPacket->seqNum) { 
-				totalMissingBytes += nextOOSPacket->seqNum - lastSeqNum;
-				printf("%d missing bytes between seq num %d and seq num %d at time %.3f\n",
-						nextOOSPacket->seqNum - lastSeqNum, lastSeqNum, nextOOSPacket->seqNum, nextOOSPacket->timeStamp);
-				fprintf(file, "%d missing bytes between seq num %d and seq num %d at time %.3f\n",
-						nextOOSPacket->seqNum - lastSeqNum, lastSeqNum, nextOOSPacket->seqNum, nextOOSPacket->timeStamp);
-				if (nextOOSPacket->timeStamp < lastTimeStamp - 20)
-					updateWarningNodes(&warningHead, oOSHT->items[i]->key, nextOOSPacket->timeStamp, nextOOSPacket->seqNum - lastSeqNum);
+	char ipString[48];
+	int text = opts->format == FORMAT_TEXT;
+	struct outBuffer records; // Open and gap records of the top connections in a structured report
+	outbuf_init(&records);
+	if (text) {
+		printf("\nConnections still open: %d\n", *openConnCt);
+		fprintf(file, "\nConnections still open: %d\n", *openConnCt);
+		printf("\nTop %u connections by %s:\n", top->count, rankName(opts->rank));
+		fprintf(file, "\nTop %u connections by %s:\n", top->count, rankName(opts->rank));
+	}
+	for (unsigned int i = 0; i < top->count; i++) {
+		struct connReport* report = &top->data[i];
+		// Warnings of a connection which closed were not counted by the scan, so they are listed without uncounting them
+		int counted = !report->closed;
+		if (text) {
+			IDToString(ipString, report->connID);
+			if (report->closed) {
+				printf("\n%s closed at %.3f after seq num %lu\n", ipString, report->timeStamp, report->seqNum);
+				fprintf(file, "\n%s closed at %.3f after seq num %lu\n", ipString, report->timeStamp, report->seqNum);
+			} else {
+				printf("\n%s expecting seq num %lu since %.3f\n", ipString, report->seqNum, report->timeStamp);
+				fprintf(file, "\n%s expecting seq num %lu since %.3f\n", ipString, report->seqNum, report->timeStamp);
+			}
+		} else if (!report->closed)
+			emit_open(&records, opts->format, report->connID, report->seqNum, report->timeStamp);
+		if (!report->closed && report->timeStamp < lastTimeStamp - 20) {
+			updateWarningNodes(warningHead, report->connID, report->timeStamp, 0L);
+			(*otherWarningCt)--;
+		}
+		for (unsigned int g = 0; g < report->gapCt; g++) {
+			struct gap* gap = &report->gaps[g];
+			if (text) {
+				printf("%lu missing bytes between seq num %lu and seq num %lu at time %.3f\n",
+						gap->toSeqNum - gap->fromSeqNum, gap->fromSeqNum, gap->toSeqNum, gap->timeStamp);
+				fprintf(file, "%lu missing bytes between seq num %lu and seq num %lu at time %.3f\n",
+						gap->toSeqNum - gap->fromSeqNum, gap->fromSeqNum, gap->toSeqNum, gap->timeStamp);
+			} else
+				emit_gap(&records, opts->format, report->connID, gap->fromSeqNum, gap->toSeqNum, gap->timeStamp);
+			if (gap->timeStamp < lastTimeStamp - 20) {
+				updateWarningNodes(warningHead, report->connID, gap->timeStamp, gap->toSeqNum - gap->fromSeqNum);
+				*otherWarningCt -= counted;
 			}
-			lastSeqNum = nextOOSPacket->seqNum + nextOOSPacket->payloadSize;
-			//puts("finished while loop (before pop)");
-			heap_pop(h);
 		}
-		
+	}
+	outbuf_write(&records, file);
+	outbuf_term(&records);
+	if (text) {
+		if (top->count == 0) {
+			puts("None.");
+			fputs("None.\n", file);
+		}
+		printf("\nAll open connections: %d with missing bytes, %lu bytes missing in %lu gap(s).\n", lossyConnCt, *totalMissingBytes, gapCt);
+		fprintf(file, "\nAll open connections: %d with missing bytes, %lu bytes missing in %lu gap(s).\n", lossyConnCt, *totalMissingBytes, gapCt);
+	}
+}
+
+/**
+ * Function for outputting the summary statistics and warnings which end every report of the exact analysis.
+ */
+void summaryTotals(FILE* file, struct options* opts, unsigned long packetCt, unsigned long byteCt, int connCt, int openConnCt,
+		unsigned long totalMissingBytes, struct warningNode* warningHead, int otherWarningCt, double lastTimeStamp,
+		struct traceTotals* totals) {
+	char ipString[48];
+	int over60sWarningFlag = 0;
+	*totals = (struct traceTotals){1, packetCt, byteCt, connCt, openConnCt, totalMissingBytes, lastTimeStamp};
+	if (opts->format != FORMAT_TEXT) {
+		// The warnings and totals become records, and only the totals are printed
+		struct outBuffer records;
+		outbuf_init(&records);
+		for (struct warningNode* node = warningHead; node != NULL; node = node->next)
+			emit_warning(&records, opts->format, node->connID, node->bytesMissing, node->timeStamp);
+		emit_summary(&records, opts->format, totals);
+		outbuf_write(&records, file);
+		outbuf_term(&records);
+		puts("\n\nSummary:");
+		printf("%lu packets checked containing a total of %lu bytes from %d connections.\n\n", packetCt, byteCt, connCt);
+		printf("%lu / %lu bytes missing from trace sequence (%.3f%% loss).\n\n", totalMissingBytes, byteCt, totalMissingBytes / (double) byteCt);
+		printf("Subsequent packets from %d open connection(s) could not be analysed.\n\n", openConnCt);
+		return;
 	}
 
 	// Print summary statistics
 	puts("\n\nSummary:");
-	printf("%d packets checked containing a total of %d bytes from %d connections.\n\n", packetCt, byteCt, connCt);
-	printf("%d / %d bytes missing from trace sequence (%.3f%% loss).\n\n", totalMissingBytes, byteCt, totalMissingBytes / (double) byteCt);
+	printf("%lu packets checked containing a total of %lu bytes from %d connections.\n\n", packetCt, byteCt, connCt);
+	printf("%lu / %lu bytes missing from trace sequence (%.3f%% loss).\n\n", totalMissingBytes, byteCt, totalMissingBytes / (double) byteCt);
 	printf("Subsequent packets from %d open connection(s) could not be analysed.\n\n\n", openConnCt);
 
 	fputs("======================================================================================\n", file);
 	fputs("\n\nSummary:\n", file);
-	fprintf(file, "%d packets checked containing a total of %d bytes from %d connections.\n\n", packetCt, byteCt, connCt);
-	fprintf(file, "%d / %d bytes missing from trace sequence (%.3f%% loss).\n\n", totalMissingBytes, byteCt, totalMissingBytes / (double) byteCt);
+	fprintf(file, "%lu packets checked containing a total of %lu bytes from %d connections.\n\n", packetCt, byteCt, connCt);
+	fprintf(file, "%lu / %lu bytes missing from trace sequence (%.3f%% loss).\n\n", totalMissingBytes, byteCt, totalMissingBytes / (double) byteCt);
 	fprintf(file, "Subsequent packets from %d open connection(s) could not be analysed.\n\n\n", openConnCt);
 
 	// Print warning for missing bytes (i) 60s before trace end and (ii) 20s before trace end
 	puts("======================================================================================");
 	fputs("======================================================================================\n", file);
-	if (warningHead != NULL) {
+	if (warningHead != NULL || otherWarningCt) {
 		puts("* Warning! Packets missing/connections open since before last 20 s of trace!\n");
 		fputs("* Warning! Packets missing/connections open since before last 20 s of trace!\n", file);
 		while (warningHead != NULL) {
@@ -284,13 +555,17 @@ void summary(ht_hash_table* connHT, struct node* head, oOS_ht_hash_table* oOSHT,
 				printf("%s open since %.3f\n", ipString, warningHead->timeStamp);
 				fprintf(file, "%s open since %.3f\n", ipString, warningHead->timeStamp);
 			} else {
-				printf("%d bytes missing from %s since %.3f\n", warningHead->bytesMissing, ipString, warningHead->timeStamp);
-				fprintf(file, "%d bytes missing from %s since %.3f\n", warningHead->bytesMissing, ipString, warningHead->timeStamp);
+				printf("%lu bytes missing from %s since %.3f\n", warningHead->bytesMissing, ipString, warningHead->timeStamp);
+				fprintf(file, "%lu bytes missing from %s since %.3f\n", warningHead->bytesMissing, ipString, warningHead->timeStamp);
 			}
 			
 			if (warningHead->timeStamp < lastTimeStamp - 60) over60sWarningFlag = 1;
 			warningHead = warningHead->next;
 		}
+		if (otherWarningCt) {
+			printf("%d more warning(s) for connections outside the top %u\n", otherWarningCt, opts->topK);
+			fprintf(file, "%d more warning(s) for connections outside the top %u\n", otherWarningCt, opts->topK);
+		}
 		if (over60sWarningFlag) {
 			puts("*\n* Warning! Packets are missing since before last 60 s of trace!\n*\n");
 			fputs("*\n* Warning! Packets are missing since before last 60 s of trace!\n*\n\n", file);
@@ -303,8 +578,249 @@ void summary(ht_hash_table* connHT, struct node* head, oOS_ht_hash_table* oOSHT,
 	puts("\n");
 	fputs("======================================================================================\n", file);
 	fputs("\n", file);
+}
+
+/**
+ * Warnings found by a summary worker, in connection order.
+ */
+struct warningList {
+	unsigned int count;
+	unsigned int size; // Size of the allocated memory (in number of warnings)
+	struct warningNode* data;
+};
+
+#define SUMMARY_MIN_CONNS_PER_THREAD 1024 // Open connections below which adding a summary thread does not pay
+
+/**
+ * Run of the open connections (in connection order) summarised by one thread, with its own output buffers.
+ */
+struct summaryWorker {
+	ht_hash_table* connHT;
+	const unsigned int* slots; // Connection table slots of the connections
+	unsigned int count;
+	double lastTimeStamp;
+	enum format format;
+	struct outBuffer open; // Lines of the "Connections still open" section (or open records)
+	struct outBuffer gaps; // Sections of the connections with bytes missing (or gap records)
+	struct warningList openWarnings;
+	struct warningList gapWarnings;
+	unsigned long missingBytes;
+	pthread_t thread;
+};
+
+/**
+ * Function for adding a warning to a worker's list. The lists are chained into one by chainWarning() once every
+ * worker has finished.
+ */
+void addWarning(struct warningList* list, uint64_t connID, double timeStamp, unsigned long bytesMissing) {
+	if (list->count == list->size) {
+		list->size = list->size ? list->size << 1 : 64;
+		list->data = realloc(list->data, sizeof(struct warningNode) * list->size);
+		if (!list->data) _exit(1); // Exit if the memory allocation fails
+	}
+	list->data[list->count++] = (struct warningNode){connID, timeStamp, bytesMissing, NULL};
+}
+
+void chainWarning(struct warningNode** warningHead, struct warningNode* node) {
+	node->next = *warningHead;
+	*warningHead = node;
+}
+
+/**
+ * Function for a summary worker: formats the open connection lines and the gaps of its run of connections into its
+ * own buffers and collects their warnings. The connection table and buffer pool are only read, so workers can share
+ * them.
+ */
+void* summariseConns(void* arg) {
+	struct summaryWorker* w = arg;
+	ht_hash_table* connHT = w->connHT;
+	char ipString[48];
+	struct oosRecord* records = NULL;
+	unsigned int recordsSize = 0;
+	for (unsigned int n = 0; n < w->count; n++) {
+		ht_item* item = &connHT->items[w->slots[n]];
+		struct connStatus* conn = &item->value;
+		if (w->format == FORMAT_TEXT) {
+			IDToString(ipString, item->key);
+			outbuf_printf(&w->open, "%s expecting seq num %u since %.3f\n", ipString, conn->seqNum, ht_time(connHT, conn));
+		} else
+			emit_open(&w->open, w->format, item->key, conn->seqNum, ht_time(connHT, conn));
+		if (ht_time(connHT, conn) < w->lastTimeStamp - 20)
+			addWarning(&w->openWarnings, item->key, ht_time(connHT, conn), 0L);
 
+		// Collate missing packets
+		unsigned int count = oos_count(connHT->oosPool, conn);
+		if (count == 0) continue;
+		if (count > recordsSize) {
+			recordsSize = count;
+			records = realloc(records, sizeof(struct oosRecord) * recordsSize);
+			if (!records) _exit(1); // Exit if the memory allocation fails
+		}
+		oos_copy_sorted(connHT->oosPool, conn, records);
+		if (w->format == FORMAT_TEXT)
+			outbuf_printf(&w->gaps, "\nBytes missing from %s: \n", ipString);
+		unsigned long lastSeqNum = conn->seqNum;
+		for (unsigned int i = 0; i < count; i++) {
+			struct oosRecord* nextOOSPacket = &records[i];
+			if (!lastSeqNum) {
+				if (w->format == FORMAT_TEXT)
+					outbuf_printf(&w->gaps, "%u missing bytes between start of connection and seq num %u (incl. SYN phantom byte) at time %.3f\n",
+							nextOOSPacket->seqNum, nextOOSPacket->seqNum, nextOOSPacket->timeStamp);
+				else
+					emit_gap(&w->gaps, w->format, item->key, 0, nextOOSPacket->seqNum, nextOOSPacket->timeStamp);
+				if (nextOOSPacket->timeStamp < w->lastTimeStamp - 20)
+					addWarning(&w->gapWarnings, item->key, nextOOSPacket->timeStamp, nextOOSPacket->seqNum);
+			} else if (lastSeqNum != nextOOSPacket->seqNum) {
+				w->missingBytes += nextOOSPacket->seqNum - lastSeqNum;
+				if (w->format == FORMAT_TEXT)
+					outbuf_printf(&w->gaps, "%ld missing bytes between seq num %lu and seq num %u at time %.3f\n",
+							(long) (nextOOSPacket->seqNum - lastSeqNum), lastSeqNum, nextOOSPacket->seqNum, nextOOSPacket->timeStamp);
+				else
+					emit_gap(&w->gaps, w->format, item->key, lastSeqNum, nextOOSPacket->seqNum, nextOOSPacket->timeStamp);
+				if (nextOOSPacket->timeStamp < w->lastTimeStamp - 20)
+					addWarning(&w->gapWarnings, item->key, nextOOSPacket->timeStamp, nextOOSPacket->seqNum - lastSeqNum);
+			}
+			lastSeqNum = nextOOSPacket->seqNum + nextOOSPacket->payloadSize;
+		}
+	}
+	free(records);
+	return NULL;
+}
+
+/**
+ * Function for printing the totals of the connections which closed with gaps left, if there are any, and adding their
+ * missing bytes to those of the trace. Their gaps are only listed if they are among the top K.
+ */
+void summaryClosedConns(FILE* file, struct closedConns* closed, int text, unsigned long* totalMissingBytes) {
+	*totalMissingBytes += closed->missingBytes;
+	if (!text || closed->lossyCt == 0) return;
+	printf("\nClosed connections: %d with missing bytes, %lu bytes missing in %lu gap(s).\n", closed->lossyCt,
+			closed->missingBytes, closed->gapCt);
+	fprintf(file, "\nClosed connections: %d with missing bytes, %lu bytes missing in %lu gap(s).\n", closed->lossyCt,
+			closed->missingBytes, closed->gapCt);
+}
+
+/**
+ * Function for outputting the summary statistics. Without -top, the open connections are summarised in parallel
+ * and reported in connection order.
+ */
+void summary(ht_hash_table* connHT, struct closedConns* closed, struct options* opts, unsigned long packetCt, unsigned long byteCt,
+		double lastTimeStamp, const char* outputFilename, struct traceTotals* totals) {
+	FILE *file;
+	file = fopen(outputFilename, "w");
+	if(file == NULL) {
+		perror("Error opening output file");
+		return;
+	}
+	
+	puts("\nParse finished! Analysing trace statistics...");
+	int text = opts->format == FORMAT_TEXT;
+	if (text) {
+		fputs("======================================================================================\n", file);
+		fprintf(file, "* OUTPUT FROM PACKET LOSS ANALYSIS of %s\n", outputFilename);
+		fputs("======================================================================================\n\n", file);
+	} else {
+		struct outBuffer header;
+		outbuf_init(&header);
+		emit_header(&header, opts->format);
+		outbuf_write(&header, file);
+		outbuf_term(&header);
+	}
+	
+	int connCt = closed->total; // Closed connections were deleted during the parse (or are lingering and skipped below)
+	int openConnCt = 0;
+	struct warningNode* warningHead = NULL;
 
+	unsigned long totalMissingBytes = 0;
+	int otherWarningCt = 0;
+	if (opts->topK) {
+		summaryTopConns(connHT, closed->top, opts, lastTimeStamp, file, &warningHead, &openConnCt, &totalMissingBytes, &otherWarningCt);
+		summaryClosedConns(file, closed, text, &totalMissingBytes);
+		connCt += openConnCt;
+	} else {
+		// Collect the open connections in connection order, so that the report does not depend on the table layout
+		unsigned int openCt = 0;
+		for (int i = 0; i < connHT->size; i++)
+			if (ht_slot_used(&connHT->items[i]) && !(connHT->items[i].value.flags & CONN_CLOSED)) openCt++;
+		uint64_t* keys = malloc(sizeof(uint64_t) * 2 * (openCt + 1));
+		unsigned int* slots = malloc(sizeof(unsigned int) * 2 * (openCt + 1));
+		if (!keys || !slots) _exit(1); // Exit if the memory allocation fails
+		unsigned int n = 0;
+		for (int i = 0; i < connHT->size; i++) {
+			if (!ht_slot_used(&connHT->items[i]) || (connHT->items[i].value.flags & CONN_CLOSED)) continue;
+			keys[n] = connHT->items[i].key;
+			slots[n++] = (unsigned int) i;
+		}
+		radix_sort_parallel(keys, slots, keys + openCt, slots + openCt, openCt, opts->threads);
+
+		// Summarise contiguous runs of the connections in parallel, each into its own buffers
+		int threads = opts->threads;
+		if (threads > (int) (openCt / SUMMARY_MIN_CONNS_PER_THREAD) + 1) threads = openCt / SUMMARY_MIN_CONNS_PER_THREAD + 1;
+		if (threads < 1) threads = 1;
+		struct summaryWorker* workers = calloc(threads, sizeof(struct summaryWorker));
+		if (!workers) _exit(1); // Exit if the memory allocation fails
+		for (int t = 0; t < threads; t++) {
+			struct summaryWorker* w = &workers[t];
+			unsigned int from = (unsigned int) ((unsigned long) openCt * t / threads);
+			unsigned int to = (unsigned int) ((unsigned long) openCt * (t + 1) / threads);
+			*w = (struct summaryWorker){.connHT = connHT, .slots = slots + from, .count = to - from, .lastTimeStamp = lastTimeStamp,
+					.format = opts->format};
+			outbuf_init(&w->open);
+			outbuf_init(&w->gaps);
+			if (t && pthread_create(&w->thread, NULL, summariseConns, w) != 0) {
+				summariseConns(w);
+				w->thread = 0;
+			}
+		}
+		summariseConns(&workers[0]);
+		for (int t = 1; t < threads; t++)
+			if (workers[t].thread) pthread_join(workers[t].thread, NULL);
+
+		// Merge the buffers in connection order with one large write each (structured records only go to the file)
+		if (text) {
+			puts("\nConnections still open:");
+			fputs("\nConnections still open:\n", file);
+		}
+		for (int t = 0; t < threads; t++) {
+			if (text) outbuf_write(&workers[t].open, stdout);
+			outbuf_write(&workers[t].open, file);
+		}
+		if (openCt == 0 && text) {
+			puts("None.");
+			fputs("None.\n", file);
+		}
+		for (int t = 0; t < threads; t++) {
+			if (text) outbuf_write(&workers[t].gaps, stdout);
+			outbuf_write(&workers[t].gaps, file);
+			totalMissingBytes += workers[t].missingBytes;
+		}
+		summaryClosedConns(file, closed, text, &totalMissingBytes);
+		openConnCt = openCt;
+		connCt += openCt;
+
+		// Chain the warnings, open connections first, each in connection order
+		for (int t = threads - 1; t >= 0; t--)
+			for (int i = (int) workers[t].gapWarnings.count - 1; i >= 0; i--)
+				chainWarning(&warningHead, &workers[t].gapWarnings.data[i]);
+		for (int t = threads - 1; t >= 0; t--)
+			for (int i = (int) workers[t].openWarnings.count - 1; i >= 0; i--)
+				chainWarning(&warningHead, &workers[t].openWarnings.data[i]);
+
+		summaryTotals(file, opts, packetCt, byteCt, connCt, openConnCt, totalMissingBytes, warningHead, otherWarningCt, lastTimeStamp, totals);
+		for (int t = 0; t < threads; t++) {
+			outbuf_term(&workers[t].open);
+			outbuf_term(&workers[t].gaps);
+			free(workers[t].openWarnings.data);
+			free(workers[t].gapWarnings.data);
+		}
+		free(workers);
+		free(keys);
+		free(slots);
+		fclose(file);
+		return;
+	}
+
+	summaryTotals(file, opts, packetCt, byteCt, connCt, openConnCt, totalMissingBytes, warningHead, otherWarningCt, lastTimeStamp, totals);
 	fclose(file);
 }
 
@@ -312,154 +828,139 @@ void summary(ht_hash_table* connHT, struct node* head, oOS_ht_hash_table* oOSHT,
 /**
  * Function for parsing the tcp input file.
  */
-void parse(const char* filename) {
+void parse(const char* filename, struct options* opts, struct traceTotals* totals) {
 	puts("parse function entered!");
-	FILE *file;
-	file = fopen(filename, "r");
-	if(file == NULL) {
-      perror("Error opening file");
-   	}	
-	char buff[16] = {0};
-	int batchCt = 0;
+	*totals = (struct traceTotals){0}; // Not analysed, until a summary fills in the totals
+	struct packetReader* reader = reader_open(filename, opts);
+	if (reader == NULL)
+		return;
 	int batchSize = 50000;
-	int packetCt = 0;
-	int byteCt = 0;
-	int lineCt = 0;
-	int charCt = 0;
-	int dataComplete = 1;
-	struct packet currPacket;
-	struct connection currConnection;
-	int connClosed = 0;
+	struct packetBatch batch;
+	unsigned long packetCt = 0;
+	unsigned long byteCt = 0;
+	int dataComplete;
+	struct packet currPacket = {0};
 	double lastTimeStamp;
-	char *outputSuffix = "-PacketLoss.txt";
-	char outputFile[30] = {0};
-
-//Initialize IP address buffers and counters for parsing trace file
-	char ip[5] = {0};
-	unsigned long ipLong = 0L;
-	int ctr = 0;
-	int i = 0;
-	int j = 0;	
 	
-//Initialize data structures for containing connections and out-of-sequence packet buffer
-	ht_hash_table* connHT = ht_new();
-	oOS_ht_hash_table* oOSHT = oOS_ht_new();
-	struct node* head = NULL;
-
-	do {
-		int c = fgetc(file);
-		if(c == EOF) 
-			break;
-		if(c == '\n' || c == '\t') {
-			switch (lineCt) {
-				case 1 : //timestamp
-					currPacket.timeStamp = atof(buff);
-					break;
-				
-				case 2 :
-					if (charCt == 0)
-						dataComplete = 0;
-					while(ctr < 4) {
-						if(buff[i] == '.' || buff[i] == 0) {
-							ipLong += atol(ip) << ((3 - ctr++) * 8);
-							j = 0;
-							i++;
-							memset(ip, 0, sizeof ip);
-						} else {
-							ip[j++] = buff[i++];
-						}
-					}
-					currConnection.sourceIP = ipLong;
-					ctr = 0;
-					i = 0;
-					ipLong = 0L;
-					break;
-				
-				case 3 :
-					if (charCt ==0)
-						dataComplete = 0;
-					currConnection.sourcePort = atol(buff);
-					break;
-				
-				case 4 :
-					if (charCt == 0)
-						dataComplete = 0;
-					while(ctr < 4) {
-						if(buff[i] == '.' || buff[i] == 0) {
-							ipLong += atol(ip) << ((3 - ctr++) * 8);
-							j = 0;
-							i++;
-							memset(ip, 0, sizeof ip);
-						} else {
-							ip[j++] = buff[i++];
-						}
-					}
-					currConnection.destIP = ipLong;
-					ctr = 0;
-					i = 0;
-					ipLong = 0L;
-					break;
-				
-				case 5 :
-					if (charCt ==0)
-						dataComplete = 0;
-					currConnection.destPort = atol(buff);
-					currPacket.connID = makeID(currConnection);
-					break;
-
-				case 8 :
-					currPacket.payloadSize = atoi(buff);
-					byteCt += currPacket.payloadSize;
-					break;
-				
-				case 9 :
-					currPacket.syn = atoi(buff);
-					break;
-				
-				case 11 :
-					currPacket.fin = atoi(buff);
-					break;
-
-				case 13 :
-					currPacket.seqNum = atoi(buff);
-			}
-			if (c == '\n') {
-				if (dataComplete) {
-					connClosed = updateSeqNums(connHT, oOSHT, currPacket);
-				}
-				if (connClosed) {
-					updateClosedConns(&head, currPacket.connID);
-					connClosed = 0;
-				}
-				lineCt = 0;
-				dataComplete = 1;
-				batchCt++;
-				packetCt++;
-				if (packetCt % 1000 == 0) {
-					printf("%d packets parsed.\n", packetCt);
-				}
-			} else {
-				lineCt += 1;
-			}
-			memset(buff, 0, sizeof buff);
-			charCt = 0;
-		} else {
-			buff[charCt++] = c;
+//Initialize data structures for containing connections and out-of-sequence packet buffer, or the fixed size sketch
+	ht_hash_table* connHT = NULL;
+	struct sketch* sk = NULL;
+	struct closedConns closed = {0};
+	struct lookupWindow lookups = {0};
+	struct topConns top;
+	if (opts->mode == MODE_SKETCH) {
+		sk = sketch_new();
+	} else if (opts->mode == MODE_EXACT) {
+		connHT = ht_new();
+		if (opts->topK) {
+			topconns_init(&top, opts->topK, opts->rank);
+			closed.top = &top;
 		}
-		
-	} while(1);
+	}
+	struct metricsSnapshot snap;
+	struct metrics* metrics = metrics_start(opts->metricsFile, opts->metricsSocket, opts->metricsInterval);
+	if (opts->batch || opts->mode == MODE_OFFLINE)
+		batch_init(&batch, batchSize);
+	struct indexWriter* index = NULL;
+	if (opts->index) {
+		if (reader->trace->gz == NULL && !reader->trace->live)
+			index = index_new(trace_offset(reader->trace));
+		else
+			printf("Warning: only uncompressed trace files can be indexed, %s is not one!\n", filename);
+	}
+	FILE* events = NULL;
+	if (opts->eventsFile != NULL && (events = fopen(opts->eventsFile, "w")) == NULL)
+		perror("Error opening events file");
+
+	int failed = 0; // Set by a bad packet, which ends the analysis
+	while (!failed && reader_next(reader, &dataComplete)) {
+		currPacket = reader->packet;
+		byteCt = reader->byteCt;
+		if (packetCt == 0 && connHT != NULL)
+			connHT->timeBase = floor(currPacket.timeStamp); // Connection time stamps are kept as offsets from the trace start
+		if (dataComplete) {
+			if (index != NULL)
+				index_add(index, currPacket.connID, reader->lineOffset);
+			if (opts->mode == MODE_OFFLINE) {
+				// Keep every packet for sorting once the whole trace is read
+				if (batch_full(&batch))
+					batch_grow(&batch);
+				batch_push(&batch, currPacket);
+			} else if (opts->batch) {
+				batch_push(&batch, currPacket);
+				if (batch_full(&batch))
+					failed = processBatch(&batch, opts, connHT, sk, &closed, events);
+			} else if (opts->mode == MODE_SKETCH)
+				sketch_update(sk, currPacket);
+			else
+				failed = lookupPacket(&lookups, connHT, &closed, currPacket, events);
+		}
+		// A live trace can pause between packets, so the packets which have arrived are handled before waiting
+		if (!failed && connHT != NULL && reader->trace->live && reader->trace->pos == reader->trace->end)
+			failed = flushLookups(&lookups, connHT, &closed, events);
+		packetCt++;
+		if (!failed && metrics_wanted(metrics)) {
+			fillMetrics(&snap, connHT, &closed, packetCt, byteCt, currPacket.timeStamp);
+			metrics_submit(metrics, &snap);
+		}
+		if (packetCt % 1000 == 0) {
+			printf("%lu packets parsed.\n", packetCt);
+		}
+	}
+	if (!failed && connHT != NULL)
+		failed = flushLookups(&lookups, connHT, &closed, events);
+	byteCt = reader->byteCt;
+	if (opts->filter != NULL)
+		printf("%d packets filtered out.\n", reader->filteredCt);
+	if (opts->batch && opts->mode != MODE_OFFLINE) {
+		if (!failed)
+			failed = processBatch(&batch, opts, connHT, sk, &closed, events);
+		batch_term(&batch);
+	}
+	if (index != NULL) {
+		if (!failed)
+			index_write(index, filename, opts->threads);
+		index_del(index);
+	}
+	if (events != NULL)
+		fclose(events);
 
 	lastTimeStamp = currPacket.timeStamp;
+	if (metrics != NULL) {
+		fillMetrics(&snap, connHT, &closed, packetCt, byteCt, lastTimeStamp);
+		metrics_stop(metrics, &snap);
+	}
+	if (connHT != NULL && connHT->timeClamped)
+		printf("Warning: trace is longer than connection time stamps can hold, later times are clamped to %.3f!\n",
+				connHT->timeBase + UINT32_MAX / CONN_TIME_UNITS);
+	if (failed) {
+		printf("Error: %s could not be analysed!\n", filename);
+		free(closed.data);
+		free(closed.reaped);
+		if (closed.top != NULL) topconns_term(closed.top);
+		reader_close(reader);
+		return;
+	}
 
-	// Create the output file name XXX-PacketLoss.txt
-	strcat(outputFile, filename);
-	int len = strlen(outputFile);
-	for (int i = len - 1; i > len - 5; i--) outputFile[i] = 0; //delete the .txt suffix
+	// Create the output file name XXX-PacketLoss.txt (or .csv, .jsonl)
+	const char* outputSuffixes[] = {"-PacketLoss.txt", "-PacketLoss.csv", "-PacketLoss.jsonl"};
+	char* outputFile = outputName(filename, outputSuffixes[opts->format]);
 	puts(outputFile);
-	strcat(outputFile, outputSuffix);
-	summary(connHT,head, oOSHT, packetCt, byteCt, lastTimeStamp, outputFile);
+	if (opts->mode == MODE_SKETCH) {
+		sketch_summary(sk, opts->topK, packetCt, byteCt, lastTimeStamp, outputFile, totals);
+		sketch_del(sk);
+	} else if (opts->mode == MODE_OFFLINE) {
+		offline_summary(&batch, opts, packetCt, byteCt, lastTimeStamp, outputFile, totals);
+		batch_term(&batch);
+	} else {
+		summary(connHT, &closed, opts, packetCt, byteCt, lastTimeStamp, outputFile, totals);
+		free(closed.data);
+		free(closed.reaped);
+		if (closed.top != NULL) topconns_term(closed.top);
+	}
+	free(outputFile);
 	puts("summary exited!");
-	fclose(file);
+	reader_close(reader);
 
 }
 
@@ -472,10 +973,97 @@ int main(int argc, char *argv[]) {
 	unsigned int connectionCounter = 0;
 	unsigned int missingBytes = 0;
 
-	const char* filename = (argc > 1) ? argv[1] : defaultFile;
+	struct options opts = {MODE_EXACT, 0, RANK_BYTES, 0, (int) sysconf(_SC_NPROCESSORS_ONLN), NULL, NULL, 1.0, NULL, NULL, NULL, DIFF_DEFAULT_WINDOW, NULL,
+			(int) sysconf(_SC_NPROCESSORS_ONLN), FORMAT_TEXT, 0, NULL, NULL};
+
+	const char* filename = defaultFile;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-sketch") == 0) {
+			opts.mode = MODE_SKETCH;
+		} else if (strcmp(argv[i], "-offline") == 0) {
+			opts.mode = MODE_OFFLINE;
+		} else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+			opts.threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-metrics") == 0 && i + 1 < argc) {
+			opts.metricsFile = argv[++i];
+		} else if (strcmp(argv[i], "-metrics-socket") == 0 && i + 1 < argc) {
+			opts.metricsSocket = argv[++i];
+		} else if (strcmp(argv[i], "-interval") == 0 && i + 1 < argc) {
+			opts.metricsInterval = atof(argv[++i]);
+		} else if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc) {
+			opts.filter = filter_compile(argv[++i]);
+			if (opts.filter == NULL)
+				return(1);
+		} else if (strcmp(argv[i], "-columns") == 0 && i + 1 < argc) {
+			opts.columnsFile = argv[++i];
+		} else if (strcmp(argv[i], "-diff") == 0 && i + 2 < argc) {
+			opts.mode = MODE_DIFF;
+			filename = argv[++i];
+			opts.diffFile = argv[++i];
+		} else if (strcmp(argv[i], "-window") == 0 && i + 1 < argc) {
+			opts.diffWindow = atof(argv[++i]);
+		} else if (strcmp(argv[i], "-fleet") == 0 && i + 1 < argc) {
+			opts.fleet = argv[++i];
+		} else if (strcmp(argv[i], "-jobs") == 0 && i + 1 < argc) {
+			opts.jobs = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-format") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "csv") == 0) opts.format = FORMAT_CSV;
+			else if (strcmp(argv[i], "jsonl") == 0) opts.format = FORMAT_JSONL;
+			else if (strcmp(argv[i], "text") == 0) opts.format = FORMAT_TEXT;
+			else {
+				printf("Error: unknown report format %s (use text, csv or jsonl)!\n", argv[i]);
+				return(1);
+			}
+		} else if (strcmp(argv[i], "-index") == 0) {
+			opts.index = 1;
+		} else if (strcmp(argv[i], "-query") == 0 && i + 1 < argc) {
+			opts.query = argv[++i];
+		} else if (strcmp(argv[i], "-events") == 0 && i + 1 < argc) {
+			opts.eventsFile = argv[++i];
+		} else if (strcmp(argv[i], "-batch") == 0) {
+			opts.batch = 1;
+		} else if (strcmp(argv[i], "-top") == 0 && i + 1 < argc) {
+			opts.topK = (unsigned int) atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-rank") == 0 && i + 1 < argc) {
+			i++;
+			if (strcmp(argv[i], "gaps") == 0) opts.rank = RANK_GAPS;
+			else if (strcmp(argv[i], "age") == 0) opts.rank = RANK_AGE;
+			else if (strcmp(argv[i], "bytes") == 0) opts.rank = RANK_BYTES;
+			else {
+				printf("Error: unknown ranking %s (use bytes, gaps or age)!\n", argv[i]);
+				return(1);
+			}
+		} else {
+			filename = argv[i];
+		}
+	}
+	if (opts.format != FORMAT_TEXT && opts.mode == MODE_SKETCH) {
+		printf("Error: -format needs the exact or offline analysis!\n");
+		return(1);
+	}
+	if (opts.eventsFile != NULL && opts.mode != MODE_EXACT) {
+		printf("Error: -events needs the exact analysis!\n");
+		return(1);
+	}
+	if (opts.fleet != NULL && (opts.mode == MODE_DIFF || opts.query != NULL || opts.eventsFile != NULL)) {
+		// Fleet workers analyse one trace each through parse(), and would all write to the same events file
+		printf("Error: -fleet cannot be combined with -diff, -query or -events!\n");
+		return(1);
+	}
+	if (opts.fleet != NULL)
+		return(fleet(opts.fleet, &opts));
 	puts(filename);
 
-	parse(filename);
+	if (opts.query != NULL)
+		return(query(filename, opts.query, &opts));
+	if (opts.mode == MODE_DIFF) {
+		int status = diff(filename, opts.diffFile, &opts);
+		puts("diff exited!");
+		return(status);
+	}
+	struct traceTotals totals = {0};
+	parse(filename, &opts, &totals);
 	puts("parse exited!");
-	return(0);	
+	return(totals.analysed ? 0 : 1);	
 }
\ No newline at end of file
@@ -10,11 +10,62 @@ struct packet {
 	uint64_t connID;
 };
 
-struct connStatus {
-	unsigned long seqNum;
+#define OOS_FIN 0x1
+#define OOS_SYN 0x2
+#define OOS_INLINE_RECORDS 3 // Out-of-sequence records held in the connection state before a heap is allocated
+
+/**
+ * Struct for the compact record of an out-of-sequence packet (16 bytes).
+ */
+struct oosRecord {
+	uint32_t seqNum;
+	uint16_t payloadSize;
+	uint16_t flags; // OOS_FIN, OOS_SYN
 	double timeStamp;
 };
 
+/**
+ * Out-of-sequence buffer of a connection, kept in a slot of the buffer pool (64 bytes, one cache line).
+ */
+struct oosBuffer {
+	unsigned int count; // Count of the inline records (0 once the buffer has overflowed)
+	uint32_t end; // End of the last record in sequence (kept in what would otherwise be padding)
+	struct oosRecord records[OOS_INLINE_RECORDS]; // Sorted from the last to the first in sequence
+	struct dheap* overflow; // Heap holding every record of the buffer after an overflow, otherwise NULL
+};
+
+#define CONN_TIME_UNITS 1000.0 // Units of connStatus.timeStamp per second (1 ms, so up to 49 days of trace)
+#define CONN_CLOSED 0x1
+
+/**
+ * Packed state of a connection (16 bytes), stored directly in the connection table.
+ */
+struct connStatus {
+	uint32_t seqNum; // Next expected relative sequence number
+	uint32_t timeStamp; // Time of the last packet in sequence, as an offset from the trace start (see ht_time())
+	uint32_t oosIdx; // Slot of the connection's out-of-sequence buffer in the pool, 0 if it has none
+	uint32_t flags; // CONN_CLOSED
+};
+
+/**
+ * Fields of a trace line which the analysis reads. Their columns depend on the trace layout (see schema.h).
+ */
+enum field {
+	FIELD_TIME,
+	FIELD_SRC_IP,
+	FIELD_SRC_PORT,
+	FIELD_DST_IP,
+	FIELD_DST_PORT,
+	FIELD_PAYLOAD,
+	FIELD_SYN,
+	FIELD_FIN,
+	FIELD_SEQ,
+	FIELD_COUNT
+};
+
+#define MAX_COLUMNS 32 // Columns of a line which can hold fields (later columns are ignored)
+#define FIELD_SIZE 32 // Longest field kept, including its terminating 0 (an epoch time to the nanosecond needs 21)
+
 struct connection {
 	unsigned long sourceIP;
 	unsigned long sourcePort;
@@ -22,9 +73,43 @@ struct connection {
 	unsigned long destPort;
 };
 
-struct node {
-    uint64_t connID;
-    struct node* next;
+#define CLOSE_LINGER 10.0 // Seconds a closed connection keeps its slot in the connection table before it is deleted
+
+struct closedConn {
+	uint64_t connID;
+	double timeStamp; // Time the connection closed
+};
+
+/**
+ * Ring buffer of closed connections waiting out CLOSE_LINGER before they are deleted from the connection table,
+ * and the set of the connections deleted since. A deleted connection's ID stays in the set for the rest of the
+ * trace (8 bytes instead of its slot), so that its late packets, such as retransmissions, never reopen it.
+ */
+struct closedConns {
+	unsigned int size; // Size of the allocated memory (in number of connections)
+	unsigned int head; // Position of the oldest connection
+	unsigned int count;
+	struct closedConn* data;
+	int total; // Count of every connection closed so far
+	unsigned int reapedSize; // Size of the set of deleted connections (a power of 2)
+	unsigned int reapedCt;
+	uint64_t* reaped; // Open addressing set of the deleted connections' IDs, 0 marking a free slot
+	struct topConns* top; // Top K connections of the run, which connections closing with gaps are offered to, or NULL
+	int lossyCt; // Connections closed with gaps left in their buffers
+	unsigned long missingBytes; // Bytes missing from those connections
+	unsigned long gapCt;
+};
+
+#define LOOKUP_AHEAD 8 // Packets read ahead of the one being handled, whose connection slots are prefetched meanwhile
+
+/**
+ * Ring of the packets read but not yet handled by the exact analysis, while their connections' slots in the
+ * connection table are loaded into the cache.
+ */
+struct lookupWindow {
+	struct packet packets[LOOKUP_AHEAD];
+	unsigned int head; // Position of the oldest packet
+	unsigned int count;
 };
 
 struct warningNode {
@@ -33,3 +118,78 @@ struct warningNode {
 	unsigned long bytesMissing;
     struct warningNode* next;
 };
+
+/**
+ * Analysis engines selectable on the command line.
+ */
+enum mode {
+	MODE_EXACT,
+	MODE_SKETCH,
+	MODE_OFFLINE,
+	MODE_DIFF
+};
+
+/**
+ * Orders for ranking connections in the top K report.
+ */
+enum rank {
+	RANK_BYTES,
+	RANK_GAPS,
+	RANK_AGE
+};
+
+/**
+ * Formats of the report file.
+ */
+enum format {
+	FORMAT_TEXT,
+	FORMAT_CSV,
+	FORMAT_JSONL
+};
+
+/**
+ * Struct for the options given on the command line.
+ */
+struct options {
+	enum mode mode;
+	unsigned int topK; // Only report details of the K lossiest connections (0 reports every connection)
+	enum rank rank;
+	int batch; // Group packets by connection in blocks before processing them
+	int threads; // Threads for the offline sort and the summary
+	const char* metricsFile; // File to keep rewriting with a metrics snapshot, or NULL
+	const char* metricsSocket; // Unix socket to serve metrics snapshots on, or NULL
+	double metricsInterval; // Seconds between metrics snapshots
+	struct filter* filter; // Only packets which pass the filter are analysed, or NULL
+	const char* columnsFile; // File naming the trace columns, for traces without a header line, or NULL
+	const char* diffFile; // Trace B of a diff, taken at the other vantage point
+	double diffWindow; // Longest one-way delay between the diffed traces (s)
+	const char* fleet; // Directory or list file of traces to analyse together, or NULL
+	int jobs; // Traces of a fleet analysed at once
+	enum format format; // Report format; structured reports (see report-records.h) are not printed to the terminal
+	int index; // Write the connection index of the trace (see index.h) while parsing it
+	const char* query; // Connections to extract through the index and analyse, or NULL
+	const char* eventsFile; // File to stamp each gap in as it is detected (see detectGap()), or NULL
+};
+
+/**
+ * Totals of the analysis of one trace, for the fleet summary of a directory or list of traces.
+ */
+struct traceTotals {
+	int analysed; // Whether the trace could be read
+	unsigned long packetCt;
+	unsigned long byteCt;
+	int connCt;
+	int openConnCt;
+	unsigned long missingBytes;
+	double lastTimeStamp;
+};
+
+uint64_t makeID(struct connection currConnection);
+unsigned long parseIP(const char* ip);
+void IDToString(char *str, uint64_t connID);
+void updateWarningNodes(struct warningNode** warningHead, uint64_t connID, double timeStamp, unsigned long bytesMissing);
+void summaryTotals(FILE* file, struct options* opts, unsigned long packetCt, unsigned long byteCt, int connCt, int openConnCt,
+		unsigned long totalMissingBytes, struct warningNode* warningHead, int otherWarningCt, double lastTimeStamp,
+		struct traceTotals* totals);
+char* outputName(const char* filename, const char* suffix);
+void parse(const char* filename, struct options* opts, struct traceTotals* totals);
@@ -0,0 +1,55 @@
+/**
+ * Memory benchmark of the connection table: tracks N flows (a given percentage of them holding two
+ * out-of-sequence packets) and reports the bytes used per tracked flow.
+ * Build in packet-loss-C/bench with:
+ * gcc -O2 -I.. -o flow-memory-bench flow-memory-bench.c ../hash-table.c ../prime.c ../oos-buffer.c ../dary-heap.c -lm
+ * Run: ./flow-memory-bench [flows] [percent with out-of-sequence packets]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "PacketLoss.h"
+#include "hash-table.h"
+#include "oos-buffer.h"
+
+// Returns the resident set size of the process in bytes
+static unsigned long residentBytes() {
+	unsigned long size = 0, resident = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (statm == NULL) return 0;
+	if (fscanf(statm, "%lu %lu", &size, &resident) != 2) resident = 0;
+	fclose(statm);
+	return resident * (unsigned long) sysconf(_SC_PAGESIZE);
+}
+
+int main(int argc, char *argv[]) {
+	unsigned int flows = argc > 1 ? (unsigned int) atoi(argv[1]) : 200000;
+	unsigned int oosPercent = argc > 2 ? (unsigned int) atoi(argv[2]) : 10;
+
+	unsigned long before = residentBytes();
+	ht_hash_table* connHT = ht_new();
+	for (unsigned int i = 0; i < flows; i++) {
+		// Spread the flows over source and destination addresses and ports like real connection IDs
+		uint64_t connID = ((uint64_t) (i % 0xfffe + 1) << 48) | ((uint64_t) (40000 + i / 0xfffe) << 32) | (0x0001ULL << 16) | 8000;
+		struct connStatus* conn = ht_insert(connHT, connID);
+		conn->seqNum = 1;
+		if (i % 100 < oosPercent) {
+			oos_push(connHT->oosPool, conn, (struct oosRecord){2897, 1448, 0, 1.0});
+			oos_push(connHT->oosPool, conn, (struct oosRecord){5793, 1448, 0, 1.5});
+		}
+	}
+	unsigned long after = residentBytes();
+
+	unsigned long tableBytes = (unsigned long) connHT->size * sizeof(ht_item);
+	unsigned long poolBytes = (unsigned long) connHT->oosPool->size * sizeof(struct oosBuffer);
+	printf("%u flows (%u%% with 2 out-of-sequence packets), table of %d slots\n", flows, oosPercent, connHT->size);
+	printf("sizeof(struct connStatus) = %zu, sizeof(ht_item) = %zu, sizeof(struct oosBuffer) = %zu\n",
+			sizeof(struct connStatus), sizeof(ht_item), sizeof(struct oosBuffer));
+	printf("table + buffer pool: %.1f bytes per flow\n", (tableBytes + poolBytes) / (double) flows);
+	printf("resident set growth: %.1f bytes per flow\n", (after - before) / (double) flows);
+	ht_del_hash_table(connHT);
+	return 0;
+}
@@ -0,0 +1,113 @@
+/**
+ * Microbenchmark of the out-of-sequence buffer heaps: the binary heap of packet pointers (min-heap.c) against
+ * the 4-ary heap of inline records (dary-heap.c).
+ * Build in packet-loss-C/bench with: gcc -O2 -I.. -o heap-bench heap-bench.c ../min-heap.c ../dary-heap.c
+ * Run: ./heap-bench [records]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "PacketLoss.h"
+#include "min-heap.h"
+#include "dary-heap.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Sequence numbers of a connection's segments, shuffled within a reordering window
+static uint32_t* makeSeqNums(unsigned int count, unsigned int window) {
+	uint32_t* seqNums = malloc(sizeof(uint32_t) * count);
+	for (unsigned int i = 0; i < count; i++)
+		seqNums[i] = 1 + i * 1448;
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int j = i + (unsigned int) (rand() % window);
+		if (j >= count) continue;
+		uint32_t temp = seqNums[i];
+		seqNums[i] = seqNums[j];
+		seqNums[j] = temp;
+	}
+	return seqNums;
+}
+
+// Pushes every packet, then pops them all (the engine allocates each buffered packet separately)
+static double benchMinHeap(const uint32_t* seqNums, unsigned int count, unsigned int burst) {
+	struct packet** packets = malloc(sizeof(struct packet*) * count);
+	for (unsigned int i = 0; i < count; i++) {
+		packets[i] = calloc(1, sizeof(struct packet));
+		packets[i]->seqNum = seqNums[i];
+		packets[i]->payloadSize = 1448;
+		packets[i]->timeStamp = i;
+	}
+	struct heap h;
+	heap_init(&h);
+	unsigned long sum = 0;
+	double start = now();
+	for (unsigned int i = 0; i < count; i += burst) {
+		unsigned int end = i + burst < count ? i + burst : count;
+		for (unsigned int j = i; j < end; j++)
+			heap_push(&h, packets[j]);
+		while (h.count) {
+			sum += heap_front(&h)->seqNum;
+			heap_pop(&h);
+		}
+	}
+	double elapsed = now() - start;
+	if (sum == 0) puts("");
+	heap_term(&h);
+	for (unsigned int i = 0; i < count; i++)
+		free(packets[i]);
+	free(packets);
+	return elapsed;
+}
+
+static double benchDHeap(const uint32_t* seqNums, unsigned int count, unsigned int burst, int bulk) {
+	struct oosRecord* records = malloc(sizeof(struct oosRecord) * count);
+	for (unsigned int i = 0; i < count; i++)
+		records[i] = (struct oosRecord){seqNums[i], 1448, 0, i};
+	struct dheap h;
+	dheap_init(&h);
+	unsigned long sum = 0;
+	double start = now();
+	for (unsigned int i = 0; i < count; i += burst) {
+		unsigned int end = i + burst < count ? i + burst : count;
+		if (bulk) {
+			dheap_push_bulk(&h, &records[i], end - i);
+		} else {
+			for (unsigned int j = i; j < end; j++)
+				dheap_push(&h, records[j]);
+		}
+		while (h.count) {
+			sum += dheap_front(&h)->seqNum;
+			dheap_pop(&h);
+		}
+	}
+	double elapsed = now() - start;
+	if (sum == 0) puts("");
+	dheap_term(&h);
+	free(records);
+	return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+	unsigned int count = argc > 1 ? (unsigned int) atoi(argv[1]) : 1000000;
+	unsigned int bursts[] = {count, 4096, 64};
+	srand(1);
+	uint32_t* seqNums = makeSeqNums(count, 1024);
+
+	printf("%u records, ns per push + pop\n", count);
+	printf("%10s %12s %12s %12s\n", "burst", "min-heap", "dary-heap", "dary bulk");
+	for (unsigned int b = 0; b < sizeof bursts / sizeof bursts[0]; b++) {
+		double binary = benchMinHeap(seqNums, count, bursts[b]);
+		double dary = benchDHeap(seqNums, count, bursts[b], 0);
+		double bulk = benchDHeap(seqNums, count, bursts[b], 1);
+		printf("%10u %12.1f %12.1f %12.1f\n", bursts[b], binary * 1e9 / count, dary * 1e9 / count, bulk * 1e9 / count);
+	}
+	free(seqNums);
+	return 0;
+}
@@ -0,0 +1,85 @@
+/**
+ * Benchmark of connection table lookups in random connection order, as on a trace with many interleaved flows:
+ * plain lookups, each stalling on its slot, against lookups whose slots are prefetched a number of packets ahead
+ * (as in lookupPacket() and processBatch()). Use enough flows for the table to be far larger than the last level cache.
+ * Build in packet-loss-C/bench with:
+ * gcc -O2 -I.. -o lookup-bench lookup-bench.c ../hash-table.c ../prime.c ../oos-buffer.c ../dary-heap.c -lm
+ * Run: ./lookup-bench [flows] [lookups]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "PacketLoss.h"
+#include "hash-table.h"
+#include "oos-buffer.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Returns the size of the last level cache in bytes, or 0 if it is not known
+static unsigned long cacheBytes() {
+	unsigned long size = 0;
+	char unit = 0;
+	FILE* file = fopen("/sys/devices/system/cpu/cpu0/cache/index3/size", "r");
+	if (file == NULL) file = fopen("/sys/devices/system/cpu/cpu0/cache/index2/size", "r");
+	if (file == NULL) return 0;
+	if (fscanf(file, "%lu%c", &size, &unit) < 1) size = 0;
+	fclose(file);
+	return unit == 'K' ? size << 10 : unit == 'M' ? size << 20 : size;
+}
+
+// Spreads the flows over source and destination addresses and ports like real connection IDs
+static uint64_t flowID(unsigned int i) {
+	return ((uint64_t) (i % 0xfffe + 1) << 48) | ((uint64_t) (40000 + i / 0xfffe) << 32) | (0x0001ULL << 16) | 8000;
+}
+
+// Looks up each connection in turn, prefetching the slot of the connection ahead lookups on (0 for none)
+static double benchLookups(ht_hash_table* connHT, const uint64_t* keys, unsigned int count, unsigned int ahead) {
+	unsigned long sum = 0;
+	double start = now();
+	for (unsigned int i = 0; i < count; i++) {
+		if (ahead && i + ahead < count)
+			ht_prefetch(connHT, keys[i + ahead]);
+		struct connStatus* conn = ht_search(connHT, keys[i]);
+		conn->seqNum++; // Update the state as updateSeqNums() does
+		sum += conn->seqNum;
+	}
+	double elapsed = now() - start;
+	if (sum == 0) puts("");
+	return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+	unsigned int flows = argc > 1 ? (unsigned int) atoi(argv[1]) : 4000000;
+	unsigned int count = argc > 2 ? (unsigned int) atoi(argv[2]) : 10000000;
+
+	ht_hash_table* connHT = ht_new();
+	for (unsigned int i = 0; i < flows; i++)
+		ht_insert(connHT, flowID(i))->seqNum = 1;
+	uint64_t* keys = malloc(sizeof(uint64_t) * count);
+	if (!keys) return 1;
+	srand(1);
+	for (unsigned int i = 0; i < count; i++)
+		keys[i] = flowID((unsigned int) (((unsigned long) rand() * RAND_MAX + rand()) % flows));
+
+	unsigned long tableBytes = (unsigned long) connHT->size * sizeof(ht_item);
+	printf("%u flows, table of %d slots (%.1f MB, last level cache %.1f MB), %u lookups\n", flows, connHT->size,
+			tableBytes / 1e6, cacheBytes() / 1e6, count);
+	unsigned int aheads[] = {0, 2, 4, 8, 16, 32};
+	for (unsigned int k = 0; k < sizeof aheads / sizeof aheads[0]; k++) {
+		double elapsed = benchLookups(connHT, keys, count, aheads[k]);
+		if (aheads[k] == 0)
+			printf("no prefetch:        %6.1f ns per lookup\n", elapsed * 1e9 / count);
+		else
+			printf("prefetch %2u ahead:  %6.1f ns per lookup\n", aheads[k], elapsed * 1e9 / count);
+	}
+	free(keys);
+	ht_del_hash_table(connHT);
+	return 0;
+}
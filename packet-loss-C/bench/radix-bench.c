@@ -0,0 +1,82 @@
+/**
+ * Microbenchmark and check of the radix sorts: radix_sort() against radix_sort_parallel() on keys shaped like
+ * those of the offline analysis (a connection in the high bits, a sequence number in the low 32). Both must give
+ * the same order and skip the same passes; the exit status is 1 if they do not.
+ * Build in packet-loss-C/bench with: gcc -O2 -I.. -o radix-bench radix-bench.c ../radix-sort.c -lpthread
+ * Run: ./radix-bench [keys] [threads]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "radix-sort.h"
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Keys of packets from a few thousand connections, each sequence number a multiple of the segment size
+static void makeKeys(uint64_t* keys, unsigned int count) {
+	for (unsigned int i = 0; i < count; i++) {
+		uint64_t conn = (uint64_t) (rand() % 4096);
+		keys[i] = conn << 32 | (uint32_t) (1 + (rand() % 100000) * 1448);
+	}
+}
+
+int main(int argc, char* argv[]) {
+	unsigned int count = argc > 1 ? (unsigned int) atoi(argv[1]) : 4000000;
+	int threads = argc > 2 ? atoi(argv[2]) : 4;
+	uint64_t* source = malloc(sizeof(uint64_t) * count);
+	uint64_t* keys[2] = {malloc(sizeof(uint64_t) * count * 2), malloc(sizeof(uint64_t) * count * 2)};
+	unsigned int* index[2] = {malloc(sizeof(unsigned int) * count * 2), malloc(sizeof(unsigned int) * count * 2)};
+	if (!source || !keys[0] || !keys[1] || !index[0] || !index[1]) {
+		printf("Error: Memory allocation failed!\n");
+		return(1);
+	}
+	srand(1);
+	makeKeys(source, count);
+
+	int passes[2];
+	double seconds[2];
+	for (int s = 0; s < 2; s++) {
+		memcpy(keys[s], source, sizeof(uint64_t) * count);
+		for (unsigned int i = 0; i < count; i++)
+			index[s][i] = i;
+		double start = now();
+		if (s == 0)
+			passes[s] = radix_sort(keys[s], index[s], keys[s] + count, index[s] + count, count);
+		else
+			passes[s] = radix_sort_parallel(keys[s], index[s], keys[s] + count, index[s] + count, count, threads);
+		seconds[s] = now() - start;
+	}
+
+	printf("%u keys, %d threads\n", count, threads);
+	printf("radix_sort:          %8.3f s, %d passes\n", seconds[0], passes[0]);
+	printf("radix_sort_parallel: %8.3f s, %d passes\n", seconds[1], passes[1]);
+	int failed = 0;
+	if (passes[0] != passes[1]) {
+		printf("Error: the sorts did %d and %d passes!\n", passes[0], passes[1]);
+		failed = 1;
+	}
+	if (memcmp(keys[0], keys[1], sizeof(uint64_t) * count) || memcmp(index[0], index[1], sizeof(unsigned int) * count)) {
+		printf("Error: the sorts gave different orders!\n");
+		failed = 1;
+	}
+	for (unsigned int i = 1; i < count && !failed; i++) {
+		if (keys[0][i - 1] > keys[0][i] || (keys[0][i - 1] == keys[0][i] && index[0][i - 1] > index[0][i])) {
+			printf("Error: the keys are not in stable order at %u!\n", i);
+			failed = 1;
+		}
+	}
+	free(source);
+	free(keys[0]);
+	free(keys[1]);
+	free(index[0]);
+	free(index[1]);
+	return(failed);
+}
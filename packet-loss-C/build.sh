@@ -0,0 +1,16 @@
+#!/bin/sh
+# Builds PacketLoss, reading plain traces through io_uring if liburing is installed (see trace-reader.h).
+# Without liburing this is the same as gcc -O2 -o PacketLoss *.c -lm -lpthread -lz.
+# Usage: ./build.sh [extra gcc options]
+
+cd "$(dirname "$0")" || exit 1
+CC=${CC:-gcc}
+URING=""
+if printf '#include <liburing.h>\nint main(void) { struct io_uring ring; return io_uring_queue_init(1, &ring, 0); }\n' |
+		$CC -x c -o /dev/null - -luring > /dev/null 2>&1; then
+	URING="-DHAVE_LIBURING -luring"
+	echo "liburing found: plain traces are read through io_uring"
+else
+	echo "liburing not found: plain traces are read by read threads"
+fi
+exec $CC -O2 "$@" -o PacketLoss *.c -lm -lpthread -lz $URING
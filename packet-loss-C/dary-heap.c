@@ -0,0 +1,120 @@
+/** 4-ary min-heap with inline packet records, adapted from min-heap.c */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "PacketLoss.h"
+#include "dary-heap.h"
+
+#define DHEAP_ARITY 4
+
+static const unsigned int base_size = 4;
+
+// Compare function for the heap: orders by sequence number, then by time stamp so duplicates pop in trace order
+static inline int cmp(const struct oosRecord* a, const struct oosRecord* b) {
+	if (a->seqNum != b->seqNum) return a->seqNum < b->seqNum;
+	return a->timeStamp <= b->timeStamp;
+}
+
+// Resizes the array to hold size records
+static void resize(struct dheap* h, unsigned int size)
+{
+	h->size = size;
+	h->data = realloc(h->data, sizeof(struct oosRecord) * h->size);
+	if (!h->data) _exit(1); // Exit if the memory allocation fails
+}
+
+// Moves temp down from index to the right position among count records
+static void sift_down(struct oosRecord* data, unsigned int count, unsigned int index, struct oosRecord temp)
+{
+	unsigned int child, swap, last;
+	for(; 1; index = swap)
+	{
+		// Find the smallest of the (up to four) children
+		child = index * DHEAP_ARITY + 1;
+		if (child >= count) break; // If there are no children, the heap is reordered
+		last = (child + DHEAP_ARITY < count) ? child + DHEAP_ARITY : count;
+		swap = child;
+		for (child++; child < last; child++)
+			if (cmp(&data[child], &data[swap])) swap = child;
+		if (cmp(&temp, &data[swap])) break; // If the smallest child is not less than the parent, the heap is reordered
+
+		data[index] = data[swap];
+	}
+	data[index] = temp;
+}
+
+// Prepares the heap for use
+void dheap_init(struct dheap* h)
+{
+	*h = (struct dheap){
+		.size = base_size,
+		.count = 0,
+		.data = malloc(sizeof(struct oosRecord) * base_size)
+	};
+	if (!h->data) _exit(1); // Exit if the memory allocation fails
+}
+
+// Inserts a record to the heap
+void dheap_push(struct dheap* h, struct oosRecord value)
+{
+	unsigned int index, parent;
+
+	// Resize the heap if it is too small to hold all the data
+	if (h->count == h->size) resize(h, h->size << 1);
+
+	// Find out where to put the record and put it
+	for(index = h->count++; index; index = parent)
+	{
+		parent = (index - 1) / DHEAP_ARITY;
+		if (cmp(&h->data[parent], &value)) break;
+		h->data[index] = h->data[parent];
+	}
+	h->data[index] = value;
+}
+
+/**
+ * Inserts several records at once. When they are many compared to the heap, they are appended and the whole
+ * array is rebuilt with dheap_heapify() in linear time instead of sifting each one up.
+ */
+void dheap_push_bulk(struct dheap* h, const struct oosRecord* values, unsigned int count)
+{
+	if (count < h->count / 2 + 2) {
+		for (unsigned int i = 0; i < count; i++)
+			dheap_push(h, values[i]);
+		return;
+	}
+
+	unsigned int size = h->size;
+	while (size < h->count + count) size <<= 1;
+	if (size != h->size) resize(h, size);
+	memcpy(&h->data[h->count], values, sizeof(struct oosRecord) * count);
+	h->count += count;
+	dheap_heapify(h->data, h->count);
+}
+
+// Removes the smallest record from the heap
+void dheap_pop(struct dheap* h)
+{
+	struct oosRecord temp = h->data[--h->count];
+
+	// Shrink with hysteresis: only when an eighth full, and only by half, so that a connection alternating
+	// between bursts does not reallocate on every burst
+	if ((h->count <= (h->size >> 3)) && (h->size > base_size)) resize(h, h->size >> 1);
+
+	if (h->count) sift_down(h->data, h->count, 0, temp);
+}
+
+// Heapifies an array of records
+void dheap_heapify(struct oosRecord* data, unsigned int count)
+{
+	if (count < 2) return;
+
+	// Move every non-leaf record to the right position in its subtree
+	unsigned int item = (count - 2) / DHEAP_ARITY + 1;
+	while (item--)
+		sift_down(data, count, item, data[item]);
+}
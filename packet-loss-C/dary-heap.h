@@ -0,0 +1,24 @@
+/**
+ * 4-ary min-heap of out-of-sequence packet records, ordered by sequence number. The records are stored inline
+ * (16 bytes each, four to a cache line), so the children compared at each level share a cache line instead of
+ * being pointers to separately allocated packets.
+ */
+
+struct dheap
+{
+	unsigned int size; // Size of the allocated memory (in number of records)
+	unsigned int count; // Count of the records in the heap
+	struct oosRecord* data; // Array with the records
+};
+
+void dheap_init(struct dheap* h);
+void dheap_push(struct dheap* h, struct oosRecord value);
+void dheap_push_bulk(struct dheap* h, const struct oosRecord* values, unsigned int count);
+void dheap_pop(struct dheap* h);
+void dheap_heapify(struct oosRecord* data, unsigned int count);
+
+// Returns a pointer to the smallest record in the heap
+#define dheap_front(h) ((h)->data)
+
+// Frees the allocated memory
+#define dheap_term(h) (free((h)->data))
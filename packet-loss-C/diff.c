@@ -0,0 +1,321 @@
+/** Two-trace diff: joins the segments of captures taken at two vantage points and reports the ones seen at only one. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "PacketLoss.h"
+#include "schema.h"
+#include "filter.h"
+#include "packet-reader.h"
+#include "diff.h"
+
+#define DIFF_INITIAL_SIZE 4096 // Initial size of the window ring (in number of segments)
+
+static const char* sideNames[2] = {"A", "B"};
+
+static inline unsigned int diffHash(uint64_t connID, uint32_t seqNum, unsigned int tableSize) {
+	uint64_t h = (connID ^ ((uint64_t) seqNum << 32 | seqNum)) * 0x9e3779b97f4a7c15ULL;
+	return (unsigned int) (h >> 32) & (tableSize - 1);
+}
+
+/**
+ * Function for indexing the segment at ring position pos in the hash table.
+ */
+static void tableInsert(struct diffWindow* w, unsigned int pos) {
+	unsigned int i = diffHash(w->ring[pos].connID, w->ring[pos].seqNum, w->tableSize);
+	while (w->table[i] != 0)
+		i = (i + 1) & (w->tableSize - 1);
+	w->table[i] = pos + 1;
+}
+
+/**
+ * Function for deleting slot i of the hash table, moving the later entries of its probe run back so that lookups
+ * need no tombstones.
+ */
+static void tableDelete(struct diffWindow* w, unsigned int i) {
+	unsigned int mask = w->tableSize - 1;
+	unsigned int j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		if (w->table[j] == 0)
+			break;
+		const struct diffSegment* s = &w->ring[w->table[j] - 1];
+		unsigned int home = diffHash(s->connID, s->seqNum, w->tableSize);
+		// An entry whose home lies cyclically in (i, j] is still reachable and stays
+		if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+		w->table[i] = w->table[j];
+		i = j;
+	}
+	w->table[i] = 0;
+}
+
+/**
+ * Function for finding the table slot of the latest unmatched segment with the given key, or -1 if there is none.
+ * A retransmitted segment has one entry per copy, all from the same point (a copy from the other point would have
+ * matched one of them).
+ */
+static int tableFind(const struct diffWindow* w, uint64_t connID, uint32_t seqNum) {
+	unsigned int i = diffHash(connID, seqNum, w->tableSize);
+	int found = -1;
+	unsigned int foundAge = 0;
+	while (w->table[i] != 0) {
+		unsigned int pos = w->table[i] - 1;
+		const struct diffSegment* s = &w->ring[pos];
+		unsigned int age = (pos + w->size - w->head) % w->size; // Position from the oldest segment of the ring
+		if (s->connID == connID && s->seqNum == seqNum && (found < 0 || age > foundAge)) {
+			found = (int) i;
+			foundAge = age;
+		}
+		i = (i + 1) & (w->tableSize - 1);
+	}
+	return found;
+}
+
+/**
+ * Function for finding the table slot of the segment at ring position pos.
+ */
+static unsigned int tableSlot(const struct diffWindow* w, unsigned int pos) {
+	unsigned int i = diffHash(w->ring[pos].connID, w->ring[pos].seqNum, w->tableSize);
+	while (w->table[i] != pos + 1)
+		i = (i + 1) & (w->tableSize - 1);
+	return i;
+}
+
+/**
+ * Function for doubling the window ring, unwrapping it to the start of the new memory, and rebuilding the table.
+ */
+static void windowGrow(struct diffWindow* w) {
+	unsigned int size = w->size ? w->size * 2 : DIFF_INITIAL_SIZE;
+	struct diffSegment* ring = malloc(size * sizeof(struct diffSegment));
+	if (!ring) _exit(1); // Exit if the memory allocation fails
+	for (unsigned int i = 0; i < w->count; i++)
+		ring[i] = w->ring[(w->head + i) % w->size];
+	free(w->ring);
+	free(w->table);
+	w->ring = ring;
+	w->size = size;
+	w->head = 0;
+	w->tableSize = size * 2;
+	w->table = calloc(w->tableSize, sizeof(uint32_t));
+	if (!w->table) _exit(1); // Exit if the memory allocation fails
+	for (unsigned int i = 0; i < w->count; i++)
+		if (!w->ring[i].matched)
+			tableInsert(w, i);
+}
+
+static void addDelay(struct diffDelays* d, double delay, double window) {
+	if (d->count == 0 || delay < d->min) d->min = delay;
+	if (d->count == 0 || delay > d->max) d->max = delay;
+	d->count++;
+	d->sum += delay;
+	unsigned int bucket = (unsigned int) (delay / DIFF_DELAY_BUCKET);
+	unsigned int buckets = (unsigned int) (window / DIFF_DELAY_BUCKET) + 1;
+	d->histogram[bucket < buckets ? bucket : buckets - 1]++;
+}
+
+// Returns the delay below which the given fraction of the delays lie, to the resolution of the histogram
+static double delayPercentile(const struct diffDelays* d, double fraction) {
+	unsigned long target = (unsigned long) (fraction * d->count);
+	unsigned long seen = 0;
+	unsigned int bucket = 0;
+	while (seen + d->histogram[bucket] <= target && seen + d->histogram[bucket] < d->count)
+		seen += d->histogram[bucket++];
+	double delay = (bucket + 0.5) * DIFF_DELAY_BUCKET;
+	return delay < d->min ? d->min : delay > d->max ? d->max : delay;
+}
+
+/**
+ * Function for reporting a segment which waited out the window without turning up at the other vantage point.
+ * Segments from outside the time span of the other capture are only counted, since it could not have seen them.
+ */
+static void expireSegment(FILE* file, const struct diffSegment* s, struct diffSide* sides) {
+	struct diffSide* seen = &sides[s->side];
+	const struct diffSide* other = &sides[!s->side];
+	if (other->packetCt == 0 || s->timeStamp < other->first || (other->done && s->timeStamp > other->last)) {
+		seen->uncoveredCt++;
+		return;
+	}
+	seen->missingCt++;
+	seen->missingBytes += s->payloadSize;
+	char connString[50];
+	IDToString(connString, s->connID);
+	printf("Missing at %s: %s seq num %u, %u bytes, seen at %s at %.6f\n",
+			other->name, connString, s->seqNum, s->payloadSize, seen->name, s->timeStamp);
+	fprintf(file, "Missing at %s: %s seq num %u, %u bytes, seen at %s at %.6f\n",
+			other->name, connString, s->seqNum, s->payloadSize, seen->name, s->timeStamp);
+}
+
+/**
+ * Function for dropping the segments which are older than the window at time now from the front of the ring.
+ */
+static void expireWindow(FILE* file, struct diffWindow* w, struct diffSide* sides, double now) {
+	while (w->count > 0 && w->ring[w->head].timeStamp < now) {
+		struct diffSegment* s = &w->ring[w->head];
+		if (!s->matched) {
+			tableDelete(w, tableSlot(w, w->head));
+			expireSegment(file, s, sides);
+		}
+		w->head = (w->head + 1) % w->size;
+		w->count--;
+	}
+}
+
+/**
+ * Function for joining a packet from one trace against the segments waiting in the window. A match gives the
+ * one-way delay and completes the segment; otherwise the segment waits for its match from the other trace. Each
+ * copy of a retransmitted segment waits on its own, and a copy from the other trace matches the latest copy seen
+ * before it: a segment is resent when its earlier copy is taken to be lost, so a copy which was lost on the link
+ * is left to expire and be reported missing instead of being paired with the retransmission's arrival.
+ */
+static void joinPacket(struct diffWindow* w, struct diffSide* sides, struct diffDelays* delays, int side,
+		const struct packet* p, double window) {
+	int slot = tableFind(w, p->connID, (uint32_t) p->seqNum);
+	if (slot >= 0) {
+		struct diffSegment* s = &w->ring[w->table[slot] - 1];
+		if (s->side == side) {
+			sides[side].duplicateCt++; // Retransmission seen again at the same point
+		} else {
+			addDelay(&delays[s->side], p->timeStamp - s->timeStamp, window);
+			s->matched = 1;
+			tableDelete(w, (unsigned int) slot);
+			return;
+		}
+	}
+	if (w->count == w->size)
+		windowGrow(w);
+	unsigned int pos = (w->head + w->count) % w->size;
+	w->ring[pos] = (struct diffSegment){p->connID, (uint32_t) p->seqNum, (uint16_t) p->payloadSize, (uint8_t) side, 0,
+			p->timeStamp};
+	w->count++;
+	tableInsert(w, pos);
+}
+
+/**
+ * Function for reading the next complete packet of a trace. Returns 0 at its end.
+ */
+static int nextPacket(struct packetReader* reader, struct diffSide* side) {
+	int dataComplete = 0;
+	while (reader_next(reader, &dataComplete)) {
+		if (!dataComplete)
+			continue;
+		if (side->packetCt++ == 0)
+			side->first = reader->packet.timeStamp;
+		side->last = reader->packet.timeStamp;
+		return 1;
+	}
+	side->done = 1;
+	return 0;
+}
+
+static void printDelays(FILE* file, const char* from, const char* to, const struct diffDelays* d) {
+	printf("%s to %s: %lu segments", from, to, d->count);
+	fprintf(file, "%s to %s: %lu segments", from, to, d->count);
+	if (d->count > 0) {
+		printf(", one-way delay min %.1f ms, mean %.1f ms, p50 %.1f ms, p95 %.1f ms, p99 %.1f ms, max %.1f ms",
+				d->min * 1000, d->sum / d->count * 1000, delayPercentile(d, 0.5) * 1000, delayPercentile(d, 0.95) * 1000,
+				delayPercentile(d, 0.99) * 1000, d->max * 1000);
+		fprintf(file, ", one-way delay min %.1f ms, mean %.1f ms, p50 %.1f ms, p95 %.1f ms, p99 %.1f ms, max %.1f ms",
+				d->min * 1000, d->sum / d->count * 1000, delayPercentile(d, 0.5) * 1000, delayPercentile(d, 0.95) * 1000,
+				delayPercentile(d, 0.99) * 1000, d->max * 1000);
+	}
+	printf("\n");
+	fprintf(file, "\n");
+}
+
+static void printSide(FILE* file, const struct diffSide* side, const struct diffSide* other) {
+	printf("Seen at %s only: %lu segments, %lu bytes (and %lu outside the capture at %s); %lu retransmissions at %s\n",
+			side->name, side->missingCt, side->missingBytes, side->uncoveredCt, other->name, side->duplicateCt, side->name);
+	fprintf(file, "Seen at %s only: %lu segments, %lu bytes (and %lu outside the capture at %s); %lu retransmissions at %s\n",
+			side->name, side->missingCt, side->missingBytes, side->uncoveredCt, other->name, side->duplicateCt, side->name);
+}
+
+/**
+ * Function for diffing trace A against trace B. Both are read in time order through their own packet reader (each
+ * with its own layout, under the same filter) and merged on the time stamps. Segments are joined on connection and
+ * sequence number, so only packets which take up sequence space (data, SYN or FIN) are compared; pure ACKs carry no
+ * sequence number of their own. The report is written to <A>-PacketDiff.txt. Returns 1 if either trace or the
+ * report could not be opened, else 0.
+ */
+int diff(const char* filenameA, const char* filenameB, struct options* opts) {
+	const char* filenames[2] = {filenameA, filenameB};
+	struct packetReader* readers[2];
+	for (int i = 0; i < 2; i++) {
+		readers[i] = reader_open(filenames[i], opts);
+		if (readers[i] == NULL) {
+			if (i == 1) reader_close(readers[0]);
+			return 1;
+		}
+	}
+
+	// Create the output file name XXX-PacketDiff.txt
+	char* outputFile = outputName(filenameA, "-PacketDiff.txt");
+	FILE* file = fopen(outputFile, "w");
+	free(outputFile);
+	if (file == NULL) {
+		perror("Error opening output file");
+		reader_close(readers[0]);
+		reader_close(readers[1]);
+		return 1;
+	}
+	fprintf(file, "* OUTPUT FROM PACKET DIFF of %s (A) and %s (B)\n", filenameA, filenameB);
+	fprintf(file, "* Segments unmatched after %.3f s are reported missing at the other point\n\n", opts->diffWindow);
+	printf("Diffing %s (A) against %s (B)\n", filenameA, filenameB);
+
+	struct diffSide sides[2] = {{0}};
+	struct diffDelays delays[2] = {{0}};
+	for (int i = 0; i < 2; i++) {
+		sides[i].name = sideNames[i];
+		delays[i].histogram = calloc((size_t) (opts->diffWindow / DIFF_DELAY_BUCKET) + 1, sizeof(unsigned int));
+		if (!delays[i].histogram) _exit(1); // Exit if the memory allocation fails
+	}
+	struct diffWindow window = {0};
+	windowGrow(&window);
+
+	int more[2];
+	for (int i = 0; i < 2; i++)
+		more[i] = nextPacket(readers[i], &sides[i]);
+	unsigned long packetCt = 0;
+	while (more[0] || more[1]) {
+		// Take the earlier packet of the two traces (A first on a tie)
+		int side = !more[1] || (more[0] && readers[0]->packet.timeStamp <= readers[1]->packet.timeStamp) ? 0 : 1;
+		struct packet p = readers[side]->packet;
+		expireWindow(file, &window, sides, p.timeStamp - opts->diffWindow);
+		if (p.payloadSize > 0 || p.syn || p.fin) {
+			sides[side].segmentCt++;
+			joinPacket(&window, sides, delays, side, &p, opts->diffWindow);
+		}
+		more[side] = nextPacket(readers[side], &sides[side]);
+		if (++packetCt % 1000 == 0) {
+			printf("%lu packets parsed.\n", packetCt);
+		}
+	}
+	expireWindow(file, &window, sides, INFINITY);
+
+	printf("\n");
+	fprintf(file, "\n");
+	for (int i = 0; i < 2; i++) {
+		printf("Trace %s (%s): %lu packets, %lu segments, %.6f to %.6f\n", sides[i].name, filenames[i],
+				sides[i].packetCt, sides[i].segmentCt, sides[i].first, sides[i].last);
+		fprintf(file, "Trace %s (%s): %lu packets, %lu segments, %.6f to %.6f\n", sides[i].name, filenames[i],
+				sides[i].packetCt, sides[i].segmentCt, sides[i].first, sides[i].last);
+	}
+	printDelays(file, "A", "B", &delays[0]);
+	printDelays(file, "B", "A", &delays[1]);
+	printSide(file, &sides[0], &sides[1]);
+	printSide(file, &sides[1], &sides[0]);
+	printf("Window ring grew to %u segments.\n", window.size);
+	fclose(file);
+
+	free(window.ring);
+	free(window.table);
+	for (int i = 0; i < 2; i++) {
+		free(delays[i].histogram);
+		reader_close(readers[i]);
+	}
+	return 0;
+}
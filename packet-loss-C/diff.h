@@ -0,0 +1,65 @@
+/**
+ * Diff of two captures of the same traffic at different vantage points, such as the ground station and island ends
+ * of the satellite link. The traces are read together in time order and their segments are joined on connection
+ * and sequence number through a hash table. A segment seen at one point which has not turned up at the other within
+ * the delay window is reported missing there; matched segments give the one-way delay. Only segments younger than
+ * the window are held, so memory depends on the delay between the traces rather than on their length.
+ *
+ * Both traces need time stamps on a common clock (such as frame.time_epoch).
+ */
+
+#define DIFF_DEFAULT_WINDOW 2.0 // Longest one-way delay expected (s)
+#define DIFF_DELAY_BUCKET 0.0001 // Resolution of the one-way delay percentiles (s)
+
+/**
+ * Segment waiting for its match at the other vantage point.
+ */
+struct diffSegment {
+	uint64_t connID;
+	uint32_t seqNum;
+	uint16_t payloadSize;
+	uint8_t side; // Trace the segment was seen in (0 for A, 1 for B)
+	uint8_t matched;
+	double timeStamp;
+};
+
+/**
+ * Segments inside the delay window: a ring in time order, indexed by a linear probing hash table.
+ */
+struct diffWindow {
+	unsigned int size; // Size of the ring (in number of segments)
+	unsigned int head; // Position of the oldest segment
+	unsigned int count;
+	struct diffSegment* ring;
+	unsigned int tableSize; // Size of the hash table (a power of 2, twice the ring size)
+	uint32_t* table; // Ring position + 1 of each unmatched segment, 0 for an empty slot
+};
+
+/**
+ * Counters of one vantage point.
+ */
+struct diffSide {
+	const char* name;
+	unsigned long packetCt;
+	unsigned long segmentCt; // Packets which take up sequence space (data, SYN or FIN)
+	unsigned long duplicateCt; // Segments seen again at the same point while waiting for a match
+	unsigned long missingCt; // Segments seen here and missing at the other point
+	unsigned long missingBytes;
+	unsigned long uncoveredCt; // Unmatched segments from before or after the other capture
+	double first; // Time stamp of the first packet
+	double last; // Time stamp of the last packet
+	int done; // Whether the trace has been read to the end
+};
+
+/**
+ * One-way delays of the segments first seen at one point and then at the other.
+ */
+struct diffDelays {
+	unsigned long count;
+	double min;
+	double max;
+	double sum;
+	unsigned int* histogram; // Count of delays per DIFF_DELAY_BUCKET, up to the window
+};
+
+int diff(const char* filenameA, const char* filenameB, struct options* opts);
@@ -0,0 +1,201 @@
+/** Packet filter compiled into clauses on the raw text of trace columns. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "PacketLoss.h"
+#include "schema.h"
+#include "filter.h"
+
+/**
+ * Function for comparing two unsigned decimal numbers written as text, without converting them: the integer parts
+ * by length and then digit by digit, then the fractions digit by digit (a missing digit counting as 0).
+ */
+static int cmpDecimal(const char* a, int aLen, const char* b, int bLen) {
+	while (aLen > 1 && a[0] == '0' && a[1] != '.') {a++; aLen--;}
+	while (bLen > 1 && b[0] == '0' && b[1] != '.') {b++; bLen--;}
+	int aInt = 0;
+	int bInt = 0;
+	while (aInt < aLen && a[aInt] != '.') aInt++;
+	while (bInt < bLen && b[bInt] != '.') bInt++;
+	if (aInt != bInt) return aInt < bInt ? -1 : 1;
+	int cmp = memcmp(a, b, aInt);
+	if (cmp) return cmp;
+	for (int i = 1; aInt + i < aLen || bInt + i < bLen; i++) {
+		char digitA = aInt + i < aLen ? a[aInt + i] : '0';
+		char digitB = bInt + i < bLen ? b[bInt + i] : '0';
+		if (digitA != digitB) return digitA < digitB ? -1 : 1;
+	}
+	return 0;
+}
+
+// Converts a dotted IP address; only needed for prefixes which do not end on an octet boundary
+static uint32_t ipValue(const char* field, int len) {
+	uint32_t addr = 0;
+	uint32_t octet = 0;
+	for (int i = 0; i < len; i++) {
+		if (field[i] == '.') {
+			addr = (addr << 8) | (octet & 0xff);
+			octet = 0;
+		} else {
+			octet = octet * 10 + (uint32_t) (field[i] - '0');
+		}
+	}
+	return (addr << 8) | (octet & 0xff);
+}
+
+/**
+ * Function for testing a column which has clauses. The column passes if any of its clauses matches.
+ */
+int filter_column(const struct filter* f, int column, const char* field, int len) {
+	for (int i = 0; i < f->clauseCt; i++) {
+		const struct filterClause* c = &f->clauses[i];
+		if (c->column != column) continue;
+		switch (c->kind) {
+			case FILTER_TEXT_PREFIX :
+				if (len >= c->loLen && memcmp(field, c->lo, c->loLen) == 0) return 1;
+				break;
+			case FILTER_TEXT_EQUAL :
+				if (len == c->loLen && memcmp(field, c->lo, len) == 0) return 1;
+				break;
+			case FILTER_IP_MASK :
+				if (len && (ipValue(field, len) & c->mask) == c->addr) return 1;
+				break;
+			case FILTER_RANGE :
+				if ((c->loLen == 0 || cmpDecimal(field, len, c->lo, c->loLen) >= 0) &&
+						(c->hiLen == 0 || cmpDecimal(field, len, c->hi, c->hiLen) <= 0)) return 1;
+				break;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Function for compiling an IP prefix such as 192.168.1.0/24, or 192.168.1 for the same prefix. Prefixes on octet
+ * boundaries are matched as text.
+ */
+static int compilePrefix(struct filterClause* c, const char* text) {
+	unsigned int octets[4] = {0};
+	int octetCt = 0;
+	int bits = -1;
+	const char* s = text;
+	while (octetCt < 4) {
+		char* end;
+		unsigned long octet = strtoul(s, &end, 10);
+		if (end == s || octet > 255) return 0;
+		octets[octetCt++] = (unsigned int) octet;
+		s = end;
+		if (*s != '.') break;
+		s++;
+	}
+	if (*s == '/') {
+		char* end;
+		bits = (int) strtol(s + 1, &end, 10);
+		if (end == s + 1 || *end || bits < 0 || bits > 32) return 0;
+	} else if (*s) {
+		return 0;
+	} else {
+		bits = octetCt * 8;
+	}
+
+	c->addr = 0;
+	for (int i = 0; i < 4; i++) c->addr = (c->addr << 8) | octets[i];
+	c->mask = bits ? 0xffffffffu << (32 - bits) : 0;
+	c->addr &= c->mask;
+	if (bits % 8) {
+		c->kind = FILTER_IP_MASK;
+		return 1;
+	}
+	c->kind = bits == 32 ? FILTER_TEXT_EQUAL : FILTER_TEXT_PREFIX;
+	c->loLen = 0;
+	for (int i = 0; i < bits / 8; i++)
+		c->loLen += sprintf(c->lo + c->loLen, i < 3 ? "%u." : "%u", (c->addr >> (24 - 8 * i)) & 0xff);
+	return 1;
+}
+
+/**
+ * Function for compiling a range such as 80-443, 80 (a single value), 100- or -200. Bounds may have fractions.
+ */
+static int compileRange(struct filterClause* c, const char* text) {
+	const char* dash = strchr(text, '-');
+	int loLen = dash ? (int) (dash - text) : (int) strlen(text);
+	const char* hi = dash ? dash + 1 : text;
+	int hiLen = (int) strlen(hi);
+	if (loLen >= FILTER_TEXT_SIZE || hiLen >= FILTER_TEXT_SIZE || (loLen == 0 && hiLen == 0)) return 0;
+	if (strspn(text, "0123456789.") != (size_t) loLen || strspn(hi, "0123456789.") != (size_t) hiLen) return 0;
+	c->kind = FILTER_RANGE;
+	memcpy(c->lo, text, loLen);
+	c->loLen = loLen;
+	memcpy(c->hi, hi, hiLen);
+	c->hiLen = hiLen;
+	return 1;
+}
+
+/**
+ * Function for compiling a filter expression: terms "src PREFIX", "dst PREFIX", "sport RANGE", "dport RANGE" and
+ * "time RANGE", optionally joined with "and". Returns NULL (after printing the problem) if the expression is bad.
+ */
+struct filter* filter_compile(const char* expression) {
+	struct filter* f = calloc(1, sizeof(struct filter));
+	char* copy = strdup(expression);
+	if (!f || !copy) _exit(1); // Exit if the memory allocation fails
+	char* save;
+	for (char* term = strtok_r(copy, " ", &save); term != NULL; term = strtok_r(NULL, " ", &save)) {
+		if (strcmp(term, "and") == 0) continue;
+		char* value = strtok_r(NULL, " ", &save);
+		if (value == NULL || f->clauseCt == FILTER_MAX_CLAUSES) {
+			printf("Error: bad filter at \"%s\"!\n", term);
+			free(copy);
+			free(f);
+			return NULL;
+		}
+		struct filterClause* c = &f->clauses[f->clauseCt];
+		int ok;
+		if (strcmp(term, "src") == 0) {
+			c->field = FIELD_SRC_IP;
+			ok = compilePrefix(c, value);
+		} else if (strcmp(term, "dst") == 0) {
+			c->field = FIELD_DST_IP;
+			ok = compilePrefix(c, value);
+		} else if (strcmp(term, "sport") == 0) {
+			c->field = FIELD_SRC_PORT;
+			ok = compileRange(c, value);
+		} else if (strcmp(term, "dport") == 0) {
+			c->field = FIELD_DST_PORT;
+			ok = compileRange(c, value);
+		} else if (strcmp(term, "time") == 0) {
+			c->field = FIELD_TIME;
+			ok = compileRange(c, value);
+		} else {
+			ok = 0;
+		}
+		if (!ok) {
+			printf("Error: bad filter term \"%s %s\"!\n", term, value);
+			free(copy);
+			free(f);
+			return NULL;
+		}
+		f->clauseCt++;
+	}
+	free(copy);
+	return f;
+}
+
+/**
+ * Function for pointing the clauses at the columns of their fields in a trace's layout.
+ */
+void filter_bind(struct filter* f, const struct schema* s) {
+	f->columns = 0;
+	for (int i = 0; i < f->clauseCt; i++) {
+		struct filterClause* c = &f->clauses[i];
+		c->column = s->column[c->field];
+		if (c->column < 0) {
+			puts("Warning: the trace has no column for a filter term, which is ignored!");
+			continue;
+		}
+		f->columns |= 1u << c->column;
+	}
+}
@@ -0,0 +1,41 @@
+/**
+ * Packet filter given on the command line, such as "src 192.168.1.0/24 dport 80-443 time 100-200". The expression is
+ * compiled into clauses on the raw text of the trace columns, so a line can be rejected as soon as one of its
+ * columns is read, before any of its fields are converted to numbers. Clauses of the same kind are alternatives
+ * (either may match); clauses of different kinds must all match.
+ */
+
+#define FILTER_MAX_CLAUSES 16
+#define FILTER_TEXT_SIZE 24
+
+enum filterKind {
+	FILTER_TEXT_PREFIX, // Field starts with the text (IP prefixes on octet boundaries)
+	FILTER_TEXT_EQUAL, // Field is the text (single IP addresses)
+	FILTER_IP_MASK, // Field is an IP address within addr/mask
+	FILTER_RANGE // Field is a decimal number within [lo, hi]
+};
+
+struct filterClause {
+	enum field field; // Field the clause applies to
+	int column; // Column of the field in the trace being read (set by filter_bind())
+	enum filterKind kind;
+	char lo[FILTER_TEXT_SIZE]; // Prefix text, or lower bound ("" for none)
+	int loLen;
+	char hi[FILTER_TEXT_SIZE]; // Upper bound ("" for none)
+	int hiLen;
+	uint32_t addr;
+	uint32_t mask;
+};
+
+struct filter {
+	uint32_t columns; // Bit set of the columns with clauses, so other columns cost one test
+	int clauseCt;
+	struct filterClause clauses[FILTER_MAX_CLAUSES];
+};
+
+// Returns whether a column passes the filter (the field is its raw text, len characters long)
+#define filter_pass(f, column, field, len) (!((f)->columns & (1u << (column))) || filter_column((f), (column), (field), (len)))
+
+struct filter* filter_compile(const char* expression);
+void filter_bind(struct filter* f, const struct schema* s);
+int filter_column(const struct filter* f, int column, const char* field, int len);
@@ -0,0 +1,265 @@
+/** Fleet run: analyses many traces at once and summarises the loss of each site. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "PacketLoss.h"
+#include "fleet.h"
+
+// Suffixes of the reports (and indexes) this program writes, which are skipped when a directory of traces is listed
+static const char* reportSuffixes[] = {"-PacketLoss.txt", "-PacketLoss.csv", "-PacketLoss.jsonl", "-PacketDiff.txt", "-FleetLoss.txt",
+		"-Query.txt", ".idx"};
+
+static void addTrace(struct fleetRun* run, const char* path) {
+	if (run->count == run->size) {
+		run->size = run->size ? run->size << 1 : 64;
+		run->traces = realloc(run->traces, sizeof(char*) * run->size);
+		if (!run->traces) _exit(1); // Exit if the memory allocation fails
+	}
+	run->traces[run->count] = strdup(path);
+	if (!run->traces[run->count]) _exit(1); // Exit if the memory allocation fails
+	run->count++;
+}
+
+static int isReport(const char* name) {
+	size_t len = strlen(name);
+	for (unsigned int i = 0; i < sizeof reportSuffixes / sizeof reportSuffixes[0]; i++) {
+		size_t suffixLen = strlen(reportSuffixes[i]);
+		if (len >= suffixLen && strcmp(name + len - suffixLen, reportSuffixes[i]) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+static int cmpNames(const void* a, const void* b) {
+	return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+/**
+ * Function for collecting the traces of a fleet: the regular files of a directory (except hidden files and
+ * reports), in name order, or the paths listed one per line in a file (blank lines and # comments are skipped).
+ * Returns 0 if the path cannot be read.
+ */
+static int listTraces(struct fleetRun* run, const char* path) {
+	struct stat st;
+	if (stat(path, &st) != 0) {
+		perror("Error opening fleet");
+		return 0;
+	}
+	if (S_ISDIR(st.st_mode)) {
+		DIR* dir = opendir(path);
+		if (dir == NULL) {
+			perror("Error opening fleet directory");
+			return 0;
+		}
+		struct dirent* entry;
+		while ((entry = readdir(dir)) != NULL) {
+			if (entry->d_name[0] == '.' || isReport(entry->d_name)) continue;
+			char* trace = malloc(strlen(path) + strlen(entry->d_name) + 2);
+			if (!trace) _exit(1); // Exit if the memory allocation fails
+			sprintf(trace, "%s/%s", path, entry->d_name);
+			if (stat(trace, &st) == 0 && S_ISREG(st.st_mode))
+				addTrace(run, trace);
+			free(trace);
+		}
+		closedir(dir);
+		qsort(run->traces, run->count, sizeof(char*), cmpNames);
+		return 1;
+	}
+
+	FILE* list = fopen(path, "r");
+	if (list == NULL) {
+		perror("Error opening fleet list");
+		return 0;
+	}
+	char* line = NULL;
+	size_t lineSize = 0;
+	ssize_t len;
+	while ((len = getline(&line, &lineSize, list)) != -1) {
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' ' || line[len - 1] == '\t'))
+			line[--len] = 0;
+		if (len == 0 || line[0] == '#') continue;
+		addTrace(run, line);
+	}
+	free(line);
+	fclose(list);
+	return 1;
+}
+
+/**
+ * Function for a worker thread, which analyses the next trace not yet taken until there are none left.
+ */
+static void* runTraces(void* arg) {
+	struct fleetRun* run = arg;
+	while (1) {
+		pthread_mutex_lock(&run->lock);
+		unsigned int i = run->next++;
+		pthread_mutex_unlock(&run->lock);
+		if (i >= run->count)
+			return NULL;
+
+		parse(run->traces[i], run->opts, &run->totals[i]);
+
+		// Progress goes to stderr, since the reports the workers print to stdout are discarded
+		const struct traceTotals* t = &run->totals[i];
+		pthread_mutex_lock(&run->lock);
+		run->done++;
+		if (t->analysed)
+			fprintf(stderr, "[%u/%u] %s: %lu / %lu bytes missing (%.3f%% loss)\n", run->done, run->count, run->traces[i],
+					t->missingBytes, t->byteCt, t->byteCt ? 100.0 * t->missingBytes / t->byteCt : 0.0);
+		else
+			fprintf(stderr, "[%u/%u] %s: could not be analysed\n", run->done, run->count, run->traces[i]);
+		pthread_mutex_unlock(&run->lock);
+	}
+}
+
+// Returns the site of a trace: its file name without directory and extensions
+static char* siteName(const char* trace) {
+	char* name = outputName(trace, "");
+	char* base = strrchr(name, '/');
+	if (base != NULL)
+		memmove(name, base + 1, strlen(base));
+	return name;
+}
+
+static const struct traceTotals* sortTotals; // Totals the site order is sorted by (qsort() has no context argument)
+
+// Orders sites by loss, the lossiest first, then by name
+static int cmpSites(const void* a, const void* b) {
+	const struct traceTotals* x = &sortTotals[*(const unsigned int*) a];
+	const struct traceTotals* y = &sortTotals[*(const unsigned int*) b];
+	double lossX = x->byteCt ? (double) x->missingBytes / x->byteCt : 0;
+	double lossY = y->byteCt ? (double) y->missingBytes / y->byteCt : 0;
+	if (lossX != lossY) return (lossX < lossY) - (lossX > lossY);
+	return (*(const unsigned int*) a > *(const unsigned int*) b) - (*(const unsigned int*) a < *(const unsigned int*) b);
+}
+
+/**
+ * Function for outputting the fleet summary: each site's totals, lossiest first, and the totals of the fleet.
+ */
+static void fleetSummary(struct fleetRun* run, const char* path) {
+	char* outputFile = outputName(path, "-FleetLoss.txt");
+	FILE* file = fopen(outputFile, "w");
+	if (file == NULL) {
+		perror("Error opening output file");
+		free(outputFile);
+		return;
+	}
+	fputs("======================================================================================\n", file);
+	fprintf(file, "* FLEET PACKET LOSS SUMMARY of %u traces in %s\n", run->count, path);
+	fputs("======================================================================================\n\n", file);
+
+	unsigned int* order = malloc(sizeof(unsigned int) * run->count);
+	if (!order) _exit(1); // Exit if the memory allocation fails
+	for (unsigned int i = 0; i < run->count; i++) order[i] = i;
+	sortTotals = run->totals;
+	qsort(order, run->count, sizeof(unsigned int), cmpSites);
+
+	unsigned long packetCt = 0, byteCt = 0, missingBytes = 0, connCt = 0, openConnCt = 0;
+	unsigned int failedCt = 0;
+	printf("\n%-32s %12s %14s %14s %9s %12s %12s\n", "Site", "Packets", "Bytes", "Missing bytes", "Loss", "Connections", "Still open");
+	fprintf(file, "%-32s %12s %14s %14s %9s %12s %12s\n", "Site", "Packets", "Bytes", "Missing bytes", "Loss", "Connections", "Still open");
+	for (unsigned int k = 0; k < run->count; k++) {
+		const struct traceTotals* t = &run->totals[order[k]];
+		if (!t->analysed) {
+			failedCt++;
+			continue;
+		}
+		char* site = siteName(run->traces[order[k]]);
+		double loss = t->byteCt ? 100.0 * t->missingBytes / t->byteCt : 0.0;
+		printf("%-32s %12lu %14lu %14lu %8.3f%% %12d %12d\n", site, t->packetCt, t->byteCt, t->missingBytes, loss, t->connCt, t->openConnCt);
+		fprintf(file, "%-32s %12lu %14lu %14lu %8.3f%% %12d %12d\n", site, t->packetCt, t->byteCt, t->missingBytes, loss, t->connCt, t->openConnCt);
+		free(site);
+		packetCt += t->packetCt;
+		byteCt += t->byteCt;
+		missingBytes += t->missingBytes;
+		connCt += t->connCt;
+		openConnCt += t->openConnCt;
+	}
+	double loss = byteCt ? 100.0 * missingBytes / byteCt : 0.0;
+	printf("%-32s %12lu %14lu %14lu %8.3f%% %12lu %12lu\n", "Fleet", packetCt, byteCt, missingBytes, loss, connCt, openConnCt);
+	fprintf(file, "%-32s %12lu %14lu %14lu %8.3f%% %12lu %12lu\n", "Fleet", packetCt, byteCt, missingBytes, loss, connCt, openConnCt);
+
+	if (failedCt) {
+		printf("\n* Warning! %u trace(s) could not be analysed:\n", failedCt);
+		fprintf(file, "\n* Warning! %u trace(s) could not be analysed:\n", failedCt);
+		for (unsigned int i = 0; i < run->count; i++) {
+			if (run->totals[i].analysed) continue;
+			puts(run->traces[i]);
+			fprintf(file, "%s\n", run->traces[i]);
+		}
+	}
+	printf("\nFleet summary written to %s\n", outputFile);
+	free(order);
+	free(outputFile);
+	fclose(file);
+}
+
+/**
+ * Function for analysing every trace of a directory or list file, opts->jobs at a time. The threads of the offline
+ * sort and the summary are shared out between the traces running at once. Returns 1 if any trace could not be
+ * analysed.
+ */
+int fleet(const char* path, struct options* opts) {
+	struct fleetRun run = {0};
+	if (!listTraces(&run, path))
+		return 1;
+	if (run.count == 0) {
+		printf("Error: no traces found in %s!\n", path);
+		free(run.traces);
+		return 1;
+	}
+
+	int jobs = opts->jobs < (int) run.count ? opts->jobs : (int) run.count;
+	if (jobs < 1) jobs = 1;
+	struct options traceOpts = *opts;
+	traceOpts.threads = opts->threads / jobs > 1 ? opts->threads / jobs : 1;
+	traceOpts.metricsFile = NULL; // A metrics file or socket follows one trace at a time
+	traceOpts.metricsSocket = NULL;
+	run.opts = &traceOpts;
+	run.totals = calloc(run.count, sizeof(struct traceTotals));
+	if (!run.totals) _exit(1); // Exit if the memory allocation fails
+	pthread_mutex_init(&run.lock, NULL);
+	printf("Analysing %u traces from %s, %d at a time.\n", run.count, path, jobs);
+
+	// The reports of traces running at once would interleave on the terminal, so they only go to their files
+	fflush(stdout);
+	int savedStdout = dup(STDOUT_FILENO);
+	int devNull = open("/dev/null", O_WRONLY);
+	if (savedStdout >= 0 && devNull >= 0)
+		dup2(devNull, STDOUT_FILENO);
+
+	pthread_t* workers = calloc(jobs, sizeof(pthread_t));
+	if (!workers) _exit(1); // Exit if the memory allocation fails
+	int started = 0;
+	while (started < jobs - 1 && pthread_create(&workers[started], NULL, runTraces, &run) == 0)
+		started++;
+	runTraces(&run);
+	for (int t = 0; t < started; t++)
+		pthread_join(workers[t], NULL);
+	free(workers);
+
+	fflush(stdout);
+	if (savedStdout >= 0 && devNull >= 0)
+		dup2(savedStdout, STDOUT_FILENO);
+	if (savedStdout >= 0) close(savedStdout);
+	if (devNull >= 0) close(devNull);
+
+	fleetSummary(&run, path);
+	int failed = 0;
+	for (unsigned int i = 0; i < run.count; i++) {
+		if (!run.totals[i].analysed) failed = 1;
+		free(run.traces[i]);
+	}
+	free(run.traces);
+	free(run.totals);
+	pthread_mutex_destroy(&run.lock);
+	return failed;
+}
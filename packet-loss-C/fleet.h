@@ -0,0 +1,20 @@
+/**
+ * Fleet run: analyses every trace of a directory or list file on a bounded pool of worker threads, each trace into
+ * its own report, then writes one summary of the loss at each site (named after its trace) and across the fleet.
+ */
+
+/**
+ * Traces of a fleet run, taken in turn by the workers.
+ */
+struct fleetRun {
+	char** traces;
+	unsigned int count;
+	unsigned int size; // Size of the allocated memory (in number of traces)
+	unsigned int next; // Next trace for a worker to take
+	unsigned int done;
+	struct traceTotals* totals; // Totals of each trace, filled in by the worker which analysed it
+	struct options* opts; // Options for each trace
+	pthread_mutex_t lock;
+};
+
+int fleet(const char* path, struct options* opts);
@@ -18,30 +18,21 @@
  **/
 
 
+#include <math.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
-#include <math.h>
+#include <unistd.h>
 
-#include "hash-table.h"
-#include "min-heap.h"
 #include "PacketLoss.h"
+#include "hash-table.h"
+#include "oos-buffer.h"
+#include "prime.h"
 
 static int HT_INITIAL_BASE_SIZE = 997;
-static int HT_PRIME_1 = 59;
-static int HT_PRIME_2 = 13;
-static ht_item HT_DELETED_ITEM = {0, NULL};
-static oOS_ht_item OOS_HT_DELETED_ITEM = {0, NULL};
 
 
-static ht_item* ht_new_item(uint64_t k, struct connStatus* v) {
-    ht_item* i = calloc(1, sizeof(ht_item));
-    i->key = k;
-    i->value = v;
-    return i;
-}
-
 static ht_hash_table* ht_new_sized(const int base_size) {
     ht_hash_table* ht = calloc(1, sizeof(ht_hash_table));
     ht->base_size = base_size;
@@ -49,58 +40,31 @@ static ht_hash_table* ht_new_sized(const int base_size) {
     ht->size = next_prime(ht->base_size);
 
     ht->count = 0;
-    ht->items = calloc((size_t)ht->size, sizeof(ht_item*));
+    ht->items = calloc((size_t)ht->size, sizeof(ht_item));
+    if (!ht || !ht->items) _exit(1); // Exit if the memory allocation fails
     return ht;
 }
 
 
 ht_hash_table* ht_new() {
-    return ht_new_sized(HT_INITIAL_BASE_SIZE);
-}
-
-
-static void ht_del_item(ht_item* i) {
-    puts("ht del item entered");
-    
-    int testitemnull = (i->value == NULL);
-    printf("test item null : %d; testitem connID: %llx, test item seqNum: %d, test item timestamp %.3f\n", testitemnull, i->key, i->value->seqNum, i->value->timeStamp);
-    fflush(stdout);
-    free(i->value);
-    puts("freed i->value");
-    fflush(stdout);
-    
-    free(i);
-    puts("freed i");
-    fflush(stdout);
+    ht_hash_table* ht = ht_new_sized(HT_INITIAL_BASE_SIZE);
+    ht->oosPool = calloc(1, sizeof(struct oosPool));
+    if (!ht->oosPool) _exit(1); // Exit if the memory allocation fails
+    oos_pool_init(ht->oosPool);
+    return ht;
 }
 
 
 void ht_del_hash_table(ht_hash_table* ht) {
-    puts("entered del hash table");
-    for (int i = 0; i < ht->size; i++) {
-        printf("i: %d; size: %d\n", i, ht->size);
-        int testitemnull = (ht->items[i] == NULL);
-        printf("test item null : %d\n", testitemnull);
-        ht_item* item = ht->items[i];
-        puts("assigned item");
-        if (item != NULL) {
-            puts("if statement entered!");
-            testitemnull = (item->value == NULL);
-            puts("item not null entered!");
-            printf("test item null : %d; test item seqNum: %d, test item timestamp %.3f\n", testitemnull, item->value->seqNum, item->value->timeStamp);
-        
-            ht_del_item(item);
-        }
-        puts("end if");
-    }
-    puts("exited for loop");
+    oos_pool_term(ht->oosPool);
+    free(ht->oosPool);
     free(ht->items);
-    puts("freed ht->items");
     free(ht);
 }
 
 
 /* Resizing functions */
+
 static void ht_resize(ht_hash_table* ht, const int base_size) {
     if (base_size < HT_INITIAL_BASE_SIZE) {
         return;
@@ -110,27 +74,25 @@ static void ht_resize(ht_hash_table* ht, const int base_size) {
     ht_hash_table* new_ht = ht_new_sized(base_size);
     
     for (int i = 0; i < ht->size; i++) {
-        // puts("replacing item!");
-        // printf("i: %d; size: %d", i, ht->size);
-        ht_item* item = ht->items[i];
-        if (item != NULL && item != &HT_DELETED_ITEM) {
-            ht_insert(new_ht, item->key, item->value);
+        ht_item* item = &ht->items[i];
+        if (ht_slot_used(item)) {
+            *ht_insert(new_ht, item->key) = item->value;
         }
     }
     ht->base_size = new_ht->base_size;
     ht->count = new_ht->count;
+    ht->deleted = 0;
 
-    // To delete new_ht, we give it ht's size and items 
+    // The connection states were copied, so the old slots are freed along with new_ht
     const int tmp_size = ht->size;
     ht->size = new_ht->size;
     new_ht->size = tmp_size;
 
-    ht_item** tmp_items = ht->items;
+    ht_item* tmp_items = ht->items;
     ht->items = new_ht->items;
     new_ht->items = tmp_items;
-    puts("before ht_del_hash_table");
-    ht_del_hash_table(new_ht);
-    puts("after ht_del_hash_table");
+    free(new_ht->items);
+    free(new_ht);
 }
 
 
@@ -145,282 +107,131 @@ static void ht_resize_down(ht_hash_table* ht) {
     ht_resize(ht, new_size);
 }
 
-static int ht_hash(uint64_t s, const int a, const int m) {
-    unsigned long hash = 0;
-    int hexDigit; 
-    for (int i = 0; i < 64 / 4; i++) {
-        hexDigit = (int) (s % 0x10L);
-        hash += (unsigned long) pow(a, hexDigit) * hexDigit; 
-        s = s >> 4;
-    }
-    
-    hash = hash % m;
-    return (int)hash;
+// Mixes the bits of a key (the MurmurHash3 finaliser), so that both probe hashes depend on all of them. A few
+// multiplies, where hashing each hex digit with pow() cost more than the cache miss on the slot.
+static inline uint64_t ht_mix(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
 }
 
-static int ht_get_hash(uint64_t s, const int num_buckets, const int attempt) {
-    const int hash_a = ht_hash(s, HT_PRIME_1, num_buckets);
-    const int hash_b = ht_hash(s, HT_PRIME_2, num_buckets/2); // divide num_buckets to avoid hash_b = num_buckets - 1
-    return (hash_a + (attempt * (hash_b + 1))) % num_buckets;
+// First slot of a key's probe sequence
+static inline int ht_probe_start(uint64_t hash, const int num_buckets) {
+    return (int) (hash % (uint64_t) num_buckets);
 }
 
+// Step between the slots of a key's probe sequence (double hashing), from 1 to num_buckets / 2
+static inline int ht_probe_step(uint64_t hash, const int num_buckets) {
+    return (int) ((hash >> 32) % (uint64_t) (num_buckets / 2)) + 1;
+}
 
-void ht_insert(ht_hash_table* ht, uint64_t key, struct connStatus* value) {
-    const int load = ht->count * 100 / ht->size;
+// Moves to the next slot of a probe sequence
+#define ht_probe_next(index, step, num_buckets) ((index) + (step) >= (num_buckets) ? (index) + (step) - (num_buckets) : (index) + (step))
+
+
+// Inserts a connection and returns its zeroed state. An existing connection with the key is reset.
+// Like the result of ht_search(), the pointer is only valid until the next insert or delete, which can resize the table.
+struct connStatus* ht_insert(ht_hash_table* ht, uint64_t key) {
+    // Deleted slots still lengthen probes, so they count towards the load until a resize clears them
+    const int load = (ht->count + ht->deleted) * 100 / ht->size;
     if (load > 70) {
-        ht_resize_up(ht);
+        if (ht->count * 100 / ht->size > 35) ht_resize_up(ht);
+        else ht_resize(ht, ht->base_size); // Mostly deleted slots: rehash at the same size
     }
-    ht_item* item = ht_new_item(key, value);
-    int index = ht_get_hash(item->key, ht->size, 0);
-    ht_item* cur_item = ht->items[index];
-    int i = 1;
-    while (cur_item != NULL) {
-        if (cur_item != &HT_DELETED_ITEM) {
-            if (cur_item->key == key) {
-                ht_del_item(cur_item);
-                ht->items[index] = item;
-                return;
-            }
+    const uint64_t hash = ht_mix(key);
+    const int step = ht_probe_step(hash, ht->size);
+    int index = ht_probe_start(hash, ht->size);
+    ht_item* cur_item = &ht->items[index];
+    ht_item* free_item = NULL;
+    while (cur_item->key != HT_EMPTY_KEY) {
+        if (cur_item->key == key) {
+            if (ht->oosPool) oos_clear(ht->oosPool, &cur_item->value);
+            memset(&cur_item->value, 0, sizeof(struct connStatus));
+            return &cur_item->value;
         }
-        index = ht_get_hash(item->key, ht->size, i);
-        cur_item = ht->items[index];
-        i++;
+        if (cur_item->key == HT_DELETED_KEY && free_item == NULL) free_item = cur_item;
+        index = ht_probe_next(index, step, ht->size);
+        cur_item = &ht->items[index];
     } 
-    ht->items[index] = item;
+    // Reuse the first deleted slot on the probe path, if any
+    if (free_item != NULL) {
+        cur_item = free_item;
+        ht->deleted--;
+    }
+    cur_item->key = key;
+    memset(&cur_item->value, 0, sizeof(struct connStatus));
     ht->count++;
+    return &cur_item->value;
 }
 
 struct connStatus* ht_search(ht_hash_table* ht, uint64_t key) {
-    int index = ht_get_hash(key, ht->size, 0);
-    ht_item* item = ht->items[index];
-    int i = 1;
-    while (item != NULL) {
-        if (item != &HT_DELETED_ITEM) {
-            if (item->key == key) {
-                return item->value;
-            }
+    const uint64_t hash = ht_mix(key);
+    const int step = ht_probe_step(hash, ht->size);
+    int index = ht_probe_start(hash, ht->size);
+    ht_item* item = &ht->items[index];
+    while (item->key != HT_EMPTY_KEY) {
+        if (item->key == key) {
+            return &item->value;
         }
-        index = ht_get_hash(key, ht->size, i);
-        item = ht->items[index];
-        i++;
+        index = ht_probe_next(index, step, ht->size);
+        item = &ht->items[index];
     } 
-    return 0L;
+    return NULL;
 }
 
 
 void ht_delete(ht_hash_table* ht, uint64_t key) {
-    puts("entered ht_delete function!");
     const int load = ht->count * 100 / ht->size;
     if (load < 10) {
         ht_resize_down(ht);
     }
-    int index = ht_get_hash(key, ht->size, 0);
-    ht_item* item = ht->items[index];
-    int i = 1;
-    while (item != NULL) {
-        if (item != &HT_DELETED_ITEM) {
-            if (item->key == key) {
-                ht_del_item(item);
-                ht->items[index] = &HT_DELETED_ITEM;
-                ht->count--;
-                return;
-            }
+    const uint64_t hash = ht_mix(key);
+    const int step = ht_probe_step(hash, ht->size);
+    int index = ht_probe_start(hash, ht->size);
+    ht_item* item = &ht->items[index];
+    while (item->key != HT_EMPTY_KEY) {
+        if (item->key == key) {
+            oos_clear(ht->oosPool, &item->value);
+            item->key = HT_DELETED_KEY;
+            ht->count--;
+            ht->deleted++;
+            return;
         }
-        index = ht_get_hash(key, ht->size, i);
-        
-        //int testitemnull = (ht->items[index] == NULL);
-        item = ht->items[index];
-        //printf("index: %d; i: %d; ht->items[index] is NULL: %d\n", index, i, testitemnull);
-        i++;
+        index = ht_probe_next(index, step, ht->size);
+        item = &ht->items[index];
     } 
 }
 
-
-
-// Additional functions for out-of-sequence ("oOS") packets hash table.
-
-static oOS_ht_item* oOS_ht_new_item(uint64_t k, struct heap* v) {
-    oOS_ht_item* i = calloc(1, sizeof(oOS_ht_item));
-    i->key = k;
-    i->value = v;
-    return i;
-}
-
-
-static oOS_ht_hash_table* oOS_ht_new_sized(const int base_size) {
-    oOS_ht_hash_table* ht = calloc(1, sizeof(oOS_ht_hash_table));
-    ht->base_size = base_size;
-
-    ht->size = next_prime(ht->base_size);
-
-    ht->count = 0;
-    ht->items = calloc((size_t)ht->size, sizeof(oOS_ht_item*));
-    return ht;
-}
-
-
-oOS_ht_hash_table* oOS_ht_new() {
-    return oOS_ht_new_sized(HT_INITIAL_BASE_SIZE);
-}
-
-static void oOS_ht_del_item(oOS_ht_item* i) {
-    puts("ht del item entered");
-    int testitemnull = (i->value == NULL);
-    printf("test item null : %d; test item seqNum: %d, test item timestamp %.3f\n", testitemnull, heap_front(i->value)->seqNum, heap_front(i->value)->timeStamp);
-    heap_term(i->value);
-    free(i->value);
-    puts("freed i->value");
-    free(i);
-    puts("freed i");
-}
-
-
-void oOS_ht_del_hash_table(oOS_ht_hash_table* ht) {
-    puts("entered del hash table");
-    for (int i = 0; i < ht->size; i++) {
-        printf("i: %d; size: %d\n", i, ht->size);
-        int testitemnull = (ht->items[i] == NULL);
-        printf("test item null : %d\n", testitemnull);
-        oOS_ht_item* item = ht->items[i];
-        if (item != NULL) {
-            puts("item not null entered!");
-            oOS_ht_del_item(item);
-            puts("oOS_ht_del_item exited");
-        }
-        puts("end if");
-    }
-    free(ht->items);
-    puts("freed oOS_ht->items");
-    free(ht);
-}
-
-
-/* Resizing functions */
-static void oOS_ht_resize(oOS_ht_hash_table* ht, const int base_size) {
-    if (base_size < HT_INITIAL_BASE_SIZE) {
-        return;
-    }
-    puts("resizing oOSHT!");
-    
-    oOS_ht_hash_table* new_ht = oOS_ht_new_sized(base_size);
-    for (int i = 0; i < ht->size; i++) {
-        oOS_ht_item* item = ht->items[i];
-        if (item != NULL && item != &OOS_HT_DELETED_ITEM) {
-            oOS_ht_insert(new_ht, item->key, item->value);
-        }
-    }
-
-    ht->base_size = new_ht->base_size;
-    ht->count = new_ht->count;
-
-    // To delete new_ht, we give it ht's size and items 
-    const int tmp_size = ht->size;
-    ht->size = new_ht->size;
-    new_ht->size = tmp_size;
-
-    oOS_ht_item** tmp_items = ht->items;
-    ht->items = new_ht->items;
-    new_ht->items = tmp_items;
-
-    oOS_ht_del_hash_table(new_ht);
-}
-
-
-static void oOS_ht_resize_up(oOS_ht_hash_table* ht) {
-    const int new_size = ht->base_size * 2;
-    oOS_ht_resize(ht, new_size);
-}
-
-
-static void oOS_ht_resize_down(oOS_ht_hash_table* ht) {
-    const int new_size = ht->base_size / 2;
-    oOS_ht_resize(ht, new_size);
-}
-
-
-static int oOS_ht_hash(uint64_t s, const int a, const int m) {
-    unsigned long hash = 0;
-    int hexDigit; 
-    for (int i = 0; i < 64 / 4; i++) {
-        hexDigit = (int) (s % 0x10L);
-        hash += (unsigned long) pow(a, hexDigit) * hexDigit; 
-        s = s >> 4;
+// Starts loading the first slot of a key's probe sequence into the cache, so that a lookup of the key a little
+// later does not stall on it. The slot is prefetched for writing, since a lookup is mostly followed by an update.
+void ht_prefetch(ht_hash_table* ht, uint64_t key) {
+    const ht_item* item = &ht->items[ht_probe_start(ht_mix(key), ht->size)];
+    __builtin_prefetch(item, 1);
+    __builtin_prefetch((const char*) (item + 1) - 1, 1); // Slots can straddle two cache lines
+}
+
+// Converts a trace time stamp to the fixed resolution offset kept in the connection state. The offset is rounded to
+// the nearest unit the way printf("%.3f") rounds the time stamp itself, so reports show the same times: on an exact
+// half the rounding error of the product decides, and a true tie goes to the even unit. Times past the range of the
+// offset are clamped, and flagged in timeClamped so that the analysis can warn about them.
+uint32_t ht_time_offset(ht_hash_table* ht, double timeStamp) {
+    double offset = timeStamp - ht->timeBase; // Exact, as timeBase is a whole number of seconds
+    if (offset <= 0) return 0;
+    double scaled = offset * CONN_TIME_UNITS;
+    double whole = floor(scaled);
+    double frac = scaled - whole;
+    if (frac == 0.5) {
+        double error = fma(offset, CONN_TIME_UNITS, -scaled); // Exact error of the rounded product
+        if (error > 0 || (error == 0 && ((uint64_t) whole & 1))) whole++;
+    } else if (frac > 0.5) {
+        whole++;
     }
-    
-    hash = hash % m;
-    return (int)hash;
-}
-
-static int oOS_ht_get_hash(uint64_t s, const int num_buckets, const int attempt) {
-    const int hash_a = ht_hash(s, HT_PRIME_1, num_buckets);
-    const int hash_b = ht_hash(s, HT_PRIME_2, num_buckets/2); // divide num_buckets to avoid hash_b = num_buckets - 1
-    return (hash_a + (attempt * (hash_b + 1))) % num_buckets;
-}
-
-
-void oOS_ht_insert(oOS_ht_hash_table* ht, uint64_t key, struct heap* value) {
-    const int load = ht->count * 100 / ht->size;
-    if (load > 70) {
-        oOS_ht_resize_up(ht);
+    if (whole > UINT32_MAX) {
+        ht->timeClamped = 1;
+        return UINT32_MAX;
     }
-    oOS_ht_item* item = oOS_ht_new_item(key, value);
-    int index = oOS_ht_get_hash(item->key, ht->size, 0);
-    oOS_ht_item* cur_item = ht->items[index];
-    int i = 1;
-    while (cur_item != NULL) {
-        if (cur_item != &OOS_HT_DELETED_ITEM) {
-            if (cur_item->key == key) {
-                oOS_ht_del_item(cur_item);
-                ht->items[index] = item;
-                return;
-            }
-        }
-        index = oOS_ht_get_hash(item->key, ht->size, i);
-        cur_item = ht->items[index];
-        i++;
-    } 
-    ht->items[index] = item;
-    ht->count++;
+    return (uint32_t) whole;
 }
-
-struct heap* oOS_ht_search(oOS_ht_hash_table* ht, uint64_t key) {
-    int index = oOS_ht_get_hash(key, ht->size, 0);
-    oOS_ht_item* item = ht->items[index];
-    int i = 1;
-    while (item != NULL) {
-        if (item != &OOS_HT_DELETED_ITEM) {
-            if (item->key == key) {
-                return item->value;
-            }
-        }
-        index = oOS_ht_get_hash(key, ht->size, i);
-        item = ht->items[index];
-        i++;
-    } 
-    return NULL;
-}
-
-
-void oOS_ht_delete(oOS_ht_hash_table* ht, uint64_t key) {
-    const int load = ht->count * 100 / ht->size;
-    if (load < 10) {
-        oOS_ht_resize_down(ht);
-    }
-    int index = oOS_ht_get_hash(key, ht->size, 0);
-    oOS_ht_item* item = ht->items[index];
-    int i = 1;
-    while (item != NULL) {
-        if (item != &OOS_HT_DELETED_ITEM) {
-            if (item->key == key) {
-                oOS_ht_del_item(item);
-                ht->items[index] = &OOS_HT_DELETED_ITEM;
-                ht->count--;
-                return;
-            }
-        }
-        index = oOS_ht_get_hash(key, ht->size, i);
-        item = ht->items[index];
-        i++;
-    } 
-    
-}
\ No newline at end of file
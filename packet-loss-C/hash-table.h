@@ -17,35 +17,39 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  **/
 
-typedef struct {
-    uint64_t key;
-    struct connStatus* value;
-} ht_item;
+#define HT_EMPTY_KEY 0
+#define HT_DELETED_KEY UINT64_MAX
 
+/**
+ * Slot of the connection table. The connection states are stored in the slots themselves, so a lookup touches
+ * one slot instead of following pointers to a separately allocated item and value.
+ */
 typedef struct {
-    uint64_t key;
-    struct heap* value;
-} oOS_ht_item;
+    uint64_t key; // HT_EMPTY_KEY or HT_DELETED_KEY if the slot holds no connection
+    struct connStatus value;
+} ht_item;
 
 typedef struct {
     int base_size;
     int size;
     int count;
-    ht_item** items;
+    int deleted; // Count of the slots marked HT_DELETED_KEY
+    ht_item* items;
+    double timeBase; // Whole second of the trace start, which connection time stamps are offsets from
+    int timeClamped; // Set once a time stamp was past the range of the offsets (see ht_time_offset())
+    struct oosPool* oosPool; // Out-of-sequence buffers of the connections
 } ht_hash_table;
 
-typedef struct {
-    int base_size;
-    int size;
-    int count;
-    oOS_ht_item** items;
-} oOS_ht_hash_table;
-
 ht_hash_table* ht_new();
-void ht_insert(ht_hash_table* ht, uint64_t key, struct connStatus* value);
+void ht_del_hash_table(ht_hash_table* ht);
+struct connStatus* ht_insert(ht_hash_table* ht, uint64_t key);
 struct connStatus* ht_search(ht_hash_table* ht, uint64_t key);
 void ht_delete(ht_hash_table* h, uint64_t key);
+void ht_prefetch(ht_hash_table* ht, uint64_t key);
+uint32_t ht_time_offset(ht_hash_table* ht, double timeStamp);
+
+// Returns whether a slot holds a connection
+#define ht_slot_used(item) ((item)->key != HT_EMPTY_KEY && (item)->key != HT_DELETED_KEY)
 
-void oOS_ht_insert(oOS_ht_hash_table* ht, uint64_t key, struct heap* value);
-struct heap* oOS_ht_search(oOS_ht_hash_table* ht, uint64_t key);
-void oOS_ht_delete(oOS_ht_hash_table* h, uint64_t key);
+// Returns the trace time stamp of a connection state, to the millisecond which reports print it with.
+#define ht_time(ht, conn) ((ht)->timeBase + (conn)->timeStamp / CONN_TIME_UNITS)
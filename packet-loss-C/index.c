@@ -0,0 +1,354 @@
+/** Sidecar connection index of a trace, and the query mode which reads a few connections through it. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "PacketLoss.h"
+#include "trace-reader.h"
+#include "schema.h"
+#include "filter.h"
+#include "packet-reader.h"
+#include "radix-sort.h"
+#include "index.h"
+
+#define INDEX_SEEN_SIZE 1024 // Initial size of the set of connections seen in a block
+
+static inline unsigned int seenHash(uint64_t connID, unsigned int size) {
+	return (unsigned int) ((connID * 0x9e3779b97f4a7c15ULL) >> 32) & (size - 1);
+}
+
+// Returns the name of the index of a trace, <trace>.idx (allocated)
+static char* indexName(const char* traceName) {
+	char* name = malloc(strlen(traceName) + 5);
+	if (!name) _exit(1); // Exit if the memory allocation fails
+	sprintf(name, "%s.idx", traceName);
+	return name;
+}
+
+/**
+ * Function for starting an index of a trace whose first packet line is at dataOffset.
+ */
+struct indexWriter* index_new(off_t dataOffset) {
+	struct indexWriter* w = calloc(1, sizeof(struct indexWriter));
+	if (!w) _exit(1); // Exit if the memory allocation fails
+	w->dataOffset = dataOffset;
+	w->blockEnd = -1;
+	w->seenSize = INDEX_SEEN_SIZE;
+	w->seenKeys = malloc(sizeof(uint64_t) * w->seenSize);
+	w->seenBlocks = calloc(w->seenSize, sizeof(uint32_t));
+	if (!w->seenKeys || !w->seenBlocks) _exit(1); // Exit if the memory allocation fails
+	return w;
+}
+
+/**
+ * Function for doubling the set of connections seen in the current block, keeping only its current entries.
+ */
+static void growSeen(struct indexWriter* w) {
+	unsigned int size = w->seenSize * 2;
+	uint64_t* keys = malloc(sizeof(uint64_t) * size);
+	uint32_t* blocks = calloc(size, sizeof(uint32_t));
+	if (!keys || !blocks) _exit(1); // Exit if the memory allocation fails
+	for (unsigned int i = 0; i < w->seenSize; i++) {
+		if (w->seenBlocks[i] != w->blockCount) continue;
+		unsigned int j = seenHash(w->seenKeys[i], size);
+		while (blocks[j] != 0)
+			j = (j + 1) & (size - 1);
+		keys[j] = w->seenKeys[i];
+		blocks[j] = w->blockCount;
+	}
+	free(w->seenKeys);
+	free(w->seenBlocks);
+	w->seenKeys = keys;
+	w->seenBlocks = blocks;
+	w->seenSize = size;
+}
+
+/**
+ * Function for indexing a packet of a connection, whose line starts at lineOffset in the trace. Lines starting past
+ * the end of the current block start a new one. Each connection is recorded once per block.
+ */
+void index_add(struct indexWriter* w, uint64_t connID, off_t lineOffset) {
+	if (lineOffset >= w->blockEnd) {
+		if (w->blockCount == w->blockSize) {
+			w->blockSize = w->blockSize ? w->blockSize << 1 : 1024;
+			w->blockOffsets = realloc(w->blockOffsets, sizeof(uint64_t) * (w->blockSize + 1));
+			if (!w->blockOffsets) _exit(1); // Exit if the memory allocation fails
+		}
+		w->blockOffsets[w->blockCount++] = (uint64_t) lineOffset;
+		w->blockEnd = lineOffset + INDEX_BLOCK_SIZE;
+		w->seenCount = 0; // Entries of earlier blocks no longer count
+	}
+
+	// Entries are tagged with their block number + 1 (blockCount), so that 0 marks a slot never used
+	unsigned int i = seenHash(connID, w->seenSize);
+	while (w->seenBlocks[i] == w->blockCount) {
+		if (w->seenKeys[i] == connID)
+			return;
+		i = (i + 1) & (w->seenSize - 1);
+	}
+	w->seenKeys[i] = connID;
+	w->seenBlocks[i] = w->blockCount;
+	if (++w->seenCount * 2 >= w->seenSize)
+		growSeen(w);
+
+	if (w->pairCount == w->pairSize) {
+		w->pairSize = w->pairSize ? w->pairSize << 1 : 4096;
+		w->keys = realloc(w->keys, sizeof(uint64_t) * w->pairSize);
+		w->blocks = realloc(w->blocks, sizeof(unsigned int) * w->pairSize);
+		if (!w->keys || !w->blocks) _exit(1); // Exit if the memory allocation fails
+	}
+	w->keys[w->pairCount] = connID;
+	w->blocks[w->pairCount++] = w->blockCount - 1;
+}
+
+/**
+ * Function for writing the index of a trace to <trace>.idx. The pairs are sorted by connection with the (stable)
+ * radix sort, which keeps each connection's blocks in trace order.
+ */
+void index_write(struct indexWriter* w, const char* traceName, int threads) {
+	struct stat st;
+	if (stat(traceName, &st) != 0) {
+		perror("Error indexing trace");
+		return;
+	}
+	uint64_t* keysTemp = malloc(sizeof(uint64_t) * (w->pairCount + 1));
+	unsigned int* blocksTemp = malloc(sizeof(unsigned int) * (w->pairCount + 1));
+	if (!keysTemp || !blocksTemp) _exit(1); // Exit if the memory allocation fails
+	radix_sort_parallel(w->keys, w->blocks, keysTemp, blocksTemp, w->pairCount, threads);
+
+	// Each run of pairs of one connection gives its entry in the connection table
+	unsigned int connCt = 0;
+	struct indexConn* conns = malloc(sizeof(struct indexConn) * (w->pairCount + 1));
+	if (!conns) _exit(1); // Exit if the memory allocation fails
+	for (unsigned int start = 0, end; start < w->pairCount; start = end) {
+		for (end = start + 1; end < w->pairCount && w->keys[end] == w->keys[start]; end++);
+		conns[connCt++] = (struct indexConn){w->keys[start], start, end - start};
+	}
+	free(keysTemp);
+	free(blocksTemp);
+
+	char* indexFile = indexName(traceName);
+	FILE* file = fopen(indexFile, "wb");
+	if (file == NULL) {
+		perror("Error opening index file");
+		free(indexFile);
+		free(conns);
+		return;
+	}
+	struct indexHeader header = {INDEX_MAGIC, (uint64_t) st.st_size, (int64_t) st.st_mtime, (uint64_t) w->dataOffset,
+			w->blockCount, connCt, w->pairCount};
+	if (w->blockOffsets == NULL) {
+		w->blockOffsets = malloc(sizeof(uint64_t));
+		if (!w->blockOffsets) _exit(1); // Exit if the memory allocation fails
+	}
+	w->blockOffsets[w->blockCount] = (uint64_t) st.st_size;
+	fwrite(&header, sizeof header, 1, file);
+	fwrite(w->blockOffsets, sizeof(uint64_t), w->blockCount + 1, file);
+	fwrite(conns, sizeof(struct indexConn), connCt, file);
+	fwrite(w->blocks, sizeof(unsigned int), w->pairCount, file);
+	if (fclose(file) != 0)
+		perror("Error writing index file");
+	else
+		printf("Index of %u connections in %u blocks written to %s\n", connCt, w->blockCount, indexFile);
+	free(indexFile);
+	free(conns);
+}
+
+void index_del(struct indexWriter* w) {
+	free(w->blockOffsets);
+	free(w->seenKeys);
+	free(w->seenBlocks);
+	free(w->keys);
+	free(w->blocks);
+	free(w);
+}
+
+/**
+ * Function for parsing a connection given as SRC:SPORT-DST:DPORT into its ID. Returns 0 if it is malformed.
+ */
+static int parseConnection(const char* text, uint64_t* connID) {
+	char src[32], dst[32];
+	unsigned long sourcePort, destPort;
+	if (sscanf(text, "%31[0-9.]:%lu-%31[0-9.]:%lu", src, &sourcePort, dst, &destPort) != 4)
+		return 0;
+	struct connection conn = {parseIP(src), sourcePort, parseIP(dst), destPort};
+	*connID = makeID(conn);
+	return 1;
+}
+
+static int cmpBlocks(const void* a, const void* b) {
+	uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Function for finding a connection in the index by binary search on its connection table, read in place.
+ * Returns 0 if the trace has no packets of the connection.
+ */
+static int findConn(int fd, const struct indexHeader* header, uint64_t connID, struct indexConn* conn) {
+	off_t table = sizeof(struct indexHeader) + sizeof(uint64_t) * ((off_t) header->blockCount + 1);
+	uint32_t lo = 0, hi = header->connCount;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (pread(fd, conn, sizeof *conn, table + (off_t) mid * sizeof *conn) != sizeof *conn)
+			return 0;
+		if (conn->connID == connID) return 1;
+		if (conn->connID < connID) lo = mid + 1;
+		else hi = mid;
+	}
+	return 0;
+}
+
+/**
+ * Function for the query mode: extracts the packets of the given connections (comma separated, each as
+ * SRC:SPORT-DST:DPORT) into <trace>-Query.txt through the trace's index, reading only the blocks which hold them,
+ * then analyses the extracted trace with the other options. Returns 1 if the query or the analysis of the extracted trace fails.
+ */
+int query(const char* filename, const char* connections, struct options* opts) {
+	uint64_t wanted[QUERY_MAX_CONNS];
+	int wantedCt = 0;
+	for (const char* c = connections; *c; ) {
+		if (wantedCt == QUERY_MAX_CONNS || !parseConnection(c, &wanted[wantedCt])) {
+			printf("Error: bad -query connection list (at most %d connections as SRC:SPORT-DST:DPORT, comma separated)!\n",
+					QUERY_MAX_CONNS);
+			return 1;
+		}
+		wantedCt++;
+		c += strcspn(c, ",");
+		if (*c == ',') c++;
+	}
+
+	char* indexFile = indexName(filename);
+	int indexFd = open(indexFile, O_RDONLY);
+	if (indexFd < 0) {
+		perror("Error opening index file (write it with -index)");
+		free(indexFile);
+		return 1;
+	}
+	free(indexFile);
+	int traceFd = open(filename, O_RDONLY);
+	struct indexHeader header;
+	struct stat st;
+	if (traceFd < 0 || fstat(traceFd, &st) != 0) {
+		perror("Error opening file");
+		close(indexFd);
+		if (traceFd >= 0) close(traceFd);
+		return 1;
+	}
+	if (pread(indexFd, &header, sizeof header, 0) != sizeof header || memcmp(header.magic, INDEX_MAGIC, 8) != 0
+			|| header.traceSize != (uint64_t) st.st_size || header.traceTime != (int64_t) st.st_mtime) {
+		printf("Error: index of %s is missing or out of date, rerun with -index!\n", filename);
+		close(indexFd);
+		close(traceFd);
+		return 1;
+	}
+
+	// Collect the blocks of the connections, each once and in trace order
+	uint32_t* blocks = NULL;
+	uint64_t blockCt = 0;
+	for (int i = 0; i < wantedCt; i++) {
+		struct indexConn conn;
+		char ipString[48];
+		IDToString(ipString, wanted[i]);
+		if (!findConn(indexFd, &header, wanted[i], &conn)) {
+			printf("No packets of %s in the index.\n", ipString);
+			continue;
+		}
+		printf("%s: packets in %lu block(s).\n", ipString, (unsigned long) conn.entryCount);
+		blocks = realloc(blocks, sizeof(uint32_t) * (blockCt + conn.entryCount + 1));
+		if (!blocks) _exit(1); // Exit if the memory allocation fails
+		off_t entries = sizeof(struct indexHeader) + sizeof(uint64_t) * ((off_t) header.blockCount + 1)
+				+ sizeof(struct indexConn) * (off_t) header.connCount;
+		pread(indexFd, blocks + blockCt, sizeof(uint32_t) * conn.entryCount,
+				entries + sizeof(uint32_t) * (off_t) conn.firstEntry);
+		blockCt += conn.entryCount;
+	}
+	qsort(blocks, blockCt, sizeof(uint32_t), cmpBlocks);
+	uint64_t uniqueCt = 0;
+	for (uint64_t i = 0; i < blockCt; i++)
+		if (uniqueCt == 0 || blocks[i] != blocks[uniqueCt - 1]) blocks[uniqueCt++] = blocks[i];
+
+	// The layout comes from the header line, read on its own (or from the columns file or full profile without one)
+	char* data = malloc(header.dataOffset + 1);
+	if (!data) _exit(1); // Exit if the memory allocation fails
+	size_t dataSize = header.dataOffset + 1;
+	ssize_t len = pread(traceFd, data, header.dataOffset, 0);
+	struct packetReader* reader = reader_new(trace_open_memory(data, len > 0 ? (size_t) len : 0), NULL, opts);
+	if (reader == NULL) {
+		free(data);
+		free(blocks);
+		close(indexFd);
+		close(traceFd);
+		return 1;
+	}
+	struct schema schema = reader->schema;
+	reader_close(reader);
+
+	char* outputFile = outputName(filename, "-Query.txt");
+	FILE* file = fopen(outputFile, "w");
+	if (file == NULL) {
+		perror("Error opening output file");
+		free(outputFile);
+		free(data);
+		free(blocks);
+		close(indexFd);
+		close(traceFd);
+		return 1;
+	}
+	fwrite(data, 1, len > 0 ? (size_t) len : 0, file);
+
+	unsigned long packetCt = 0;
+	unsigned long bytesRead = 0;
+	for (uint64_t i = 0; i < uniqueCt; i++) {
+		uint64_t range[2];
+		pread(indexFd, range, sizeof range, sizeof(struct indexHeader) + sizeof(uint64_t) * (off_t) blocks[i]);
+		size_t size = (size_t) (range[1] - range[0]);
+		if (size > dataSize) {
+			dataSize = size;
+			data = realloc(data, dataSize);
+			if (!data) _exit(1); // Exit if the memory allocation fails
+		}
+		len = pread(traceFd, data, size, (off_t) range[0]);
+		if (len < 0) {
+			perror("Error reading trace");
+			break;
+		}
+		bytesRead += (unsigned long) len;
+
+		// Keep the lines of the block with packets of the connections, as they are in the trace
+		reader = reader_new(trace_open_memory(data, (size_t) len), &schema, opts);
+		int dataComplete;
+		while (reader_next(reader, &dataComplete)) {
+			if (!dataComplete) continue;
+			for (int k = 0; k < wantedCt; k++) {
+				if (reader->packet.connID != wanted[k]) continue;
+				fwrite(data + reader->lineOffset, 1, (size_t) (trace_offset(reader->trace) - reader->lineOffset), file);
+				packetCt++;
+				break;
+			}
+		}
+		reader_close(reader);
+	}
+	fclose(file);
+	printf("Extracted %lu packet(s) into %s, reading %lu of %u blocks (%lu of %lu bytes).\n\n", packetCt, outputFile,
+			(unsigned long) uniqueCt, header.blockCount, bytesRead, (unsigned long) st.st_size);
+	free(data);
+	free(blocks);
+	close(indexFd);
+	close(traceFd);
+
+	// Analyse the extracted trace as any other (its lines are already filtered)
+	struct options queryOpts = *opts;
+	queryOpts.index = 0;
+	queryOpts.filter = NULL;
+	struct traceTotals totals;
+	parse(outputFile, &queryOpts, &totals);
+	free(outputFile);
+	return !totals.analysed;
+}
@@ -0,0 +1,55 @@
+/**
+ * Sidecar index of a trace (<trace>.idx, written while parsing with -index), mapping each connection to the blocks
+ * of the trace which hold its packets. -query then extracts a few connections into a trace of their own, reading
+ * only their blocks, and analyses it. Blocks are runs of whole lines of about INDEX_BLOCK_SIZE bytes; compressed
+ * traces cannot be read from a block onwards, so only plain traces are indexed.
+ *
+ * Index file layout (native byte order): struct indexHeader; the offset of each block in the trace (uint64_t,
+ * blockCount + 1 of them, the last being the end of the trace); a struct indexConn per connection in connection ID
+ * order; then the block numbers (uint32_t) of each connection in turn.
+ */
+
+#define INDEX_BLOCK_SIZE (64 << 10)
+#define INDEX_MAGIC "PLINDEX1"
+#define QUERY_MAX_CONNS 64
+
+struct indexHeader {
+	char magic[8];
+	uint64_t traceSize; // Size and modification time of the indexed trace, to tell when the index is out of date
+	int64_t traceTime;
+	uint64_t dataOffset; // Length of the header line of the trace (0 if it has none)
+	uint32_t blockCount;
+	uint32_t connCount;
+	uint64_t entryCount; // Block numbers in the index
+};
+
+struct indexConn {
+	uint64_t connID;
+	uint64_t firstEntry; // Position of the connection's first block number
+	uint64_t entryCount;
+};
+
+/**
+ * Index being built while a trace is parsed: one (connection, block) pair for each connection seen in each block.
+ */
+struct indexWriter {
+	off_t dataOffset;
+	unsigned int blockCount;
+	unsigned int blockSize; // Size of the allocated memory for the block offsets (in number of blocks)
+	uint64_t* blockOffsets;
+	off_t blockEnd; // Lines starting from here on go into a new block
+	uint64_t* seenKeys; // Set of the connections seen in the current block, an open addressing table whose entries
+	uint32_t* seenBlocks; // only count if their block is the current one (so it is emptied by starting a block)
+	unsigned int seenSize;
+	unsigned int seenCount;
+	uint64_t* keys; // Connection of each pair
+	unsigned int* blocks; // Block of each pair
+	unsigned int pairCount;
+	unsigned int pairSize; // Size of the allocated memory (in number of pairs)
+};
+
+struct indexWriter* index_new(off_t dataOffset);
+void index_add(struct indexWriter* w, uint64_t connID, off_t lineOffset);
+void index_write(struct indexWriter* w, const char* traceName, int threads);
+void index_del(struct indexWriter* w);
+int query(const char* filename, const char* connections, struct options* opts);
@@ -0,0 +1,204 @@
+/** Metrics snapshots published by a background thread to a file and/or a Unix socket. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+
+static double elapsed(const struct timespec* start) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Returns the real time the given number of seconds from now, for pthread_cond_timedwait()
+static struct timespec deadline(double seconds) {
+	struct timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	long nsec = t.tv_nsec + (long) ((seconds - (long) seconds) * 1e9);
+	t.tv_sec += (time_t) seconds + nsec / 1000000000L;
+	t.tv_nsec = nsec % 1000000000L;
+	return t;
+}
+
+/**
+ * Function for formatting a snapshot as one JSON object, with the rates since the previous snapshot.
+ */
+static int formatSnapshot(char* buff, size_t size, const struct metricsSnapshot* snap, const struct metricsSnapshot* prev) {
+	double span = snap->wallTime - prev->wallTime;
+	double packetRate = span > 0 ? (snap->packets - prev->packets) / span : 0;
+	double byteRate = span > 0 ? (snap->bytes - prev->bytes) / span : 0;
+	int len = snprintf(buff, size,
+			"{\"time\": %.3f, \"trace_time\": %.6f, \"packets\": %lu, \"bytes\": %lu, "
+			"\"packets_per_sec\": %.1f, \"bytes_per_sec\": %.1f",
+			snap->wallTime, snap->traceTime, snap->packets, snap->bytes, packetRate, byteRate);
+	if (snap->openConns >= 0) {
+		len += snprintf(buff + len, size - len,
+				", \"open_connections\": %ld, \"oos_records\": %lu, \"oos_bytes\": %lu, \"missing_bytes\": %lu, "
+				"\"loss\": %.6f, \"table_load\": %.3f, \"table_fill\": %.3f, \"oos_pool_load\": %.3f",
+				snap->openConns, snap->oosRecords, snap->oosBytes, snap->missingBytes,
+				snap->bytes ? snap->missingBytes / (double) snap->bytes : 0.0,
+				snap->tableLoad, snap->tableFill, snap->poolLoad);
+	}
+	len += snprintf(buff + len, size - len, ", \"final\": %s}\n", snap->final ? "true" : "false");
+	return len;
+}
+
+// Replaces the snapshot file in one step, so a reader sees either the previous snapshot or this one
+static void writeSnapshotFile(const char* path, const char* text) {
+	char tmpPath[4096];
+	snprintf(tmpPath, sizeof tmpPath, "%s.tmp", path);
+	FILE* file = fopen(tmpPath, "w");
+	if (file == NULL) {
+		perror("Error opening metrics file");
+		return;
+	}
+	fputs(text, file);
+	if (fclose(file) != 0 || rename(tmpPath, path) != 0)
+		perror("Error writing metrics file");
+}
+
+// Sends the latest snapshot to every client waiting on the socket
+static void serveClients(int listenFd, const char* text, size_t len) {
+	int fd;
+	while ((fd = accept(listenFd, NULL, NULL)) >= 0) {
+		if (write(fd, text, len) < 0) perror("Error writing metrics socket");
+		close(fd);
+	}
+}
+
+static int openSocket(const char* path) {
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	if (strlen(path) >= sizeof addr.sun_path) {
+		printf("Error: metrics socket path %s is too long!\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("Error opening metrics socket");
+		return -1;
+	}
+	unlink(path);
+	if (bind(fd, (struct sockaddr*) &addr, sizeof addr) != 0 || listen(fd, 8) != 0) {
+		perror("Error opening metrics socket");
+		close(fd);
+		return -1;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	return fd;
+}
+
+/**
+ * Function for the publisher thread. Every interval it asks the parse thread for a snapshot and publishes it;
+ * between snapshots it keeps answering socket clients with the latest one.
+ */
+static void* publish(void* arg) {
+	struct metrics* m = arg;
+	struct metricsSnapshot prev = {0};
+	struct metricsSnapshot snap = {0};
+	char text[1024];
+	int len = formatSnapshot(text, sizeof text, &snap, &prev);
+	double next = m->interval;
+
+	pthread_mutex_lock(&m->lock);
+	while (1) {
+		// Wait for the next snapshot, or for the parse to end
+		while (!m->stop) {
+			double wait = next - elapsed(&m->start);
+			if (wait <= 0) break;
+			if (m->listenFd >= 0 && wait > METRICS_SOCKET_POLL) wait = METRICS_SOCKET_POLL;
+			struct timespec until = deadline(wait);
+			pthread_cond_timedwait(&m->cond, &m->lock, &until);
+			if (m->listenFd >= 0) {
+				pthread_mutex_unlock(&m->lock);
+				serveClients(m->listenFd, text, len);
+				pthread_mutex_lock(&m->lock);
+			}
+		}
+		if (!m->stop) {
+			__atomic_store_n(&m->requested, 1, __ATOMIC_RELAXED);
+			while (m->requested && !m->stop)
+				pthread_cond_wait(&m->cond, &m->lock);
+		}
+		snap = m->snap;
+		int stop = m->stop;
+		pthread_mutex_unlock(&m->lock);
+
+		snap.wallTime = elapsed(&m->start);
+		len = formatSnapshot(text, sizeof text, &snap, &prev);
+		prev = snap;
+		if (m->file != NULL) writeSnapshotFile(m->file, text);
+		if (m->listenFd >= 0) serveClients(m->listenFd, text, len);
+		if (stop) return NULL;
+		while (next <= snap.wallTime) next += m->interval;
+
+		pthread_mutex_lock(&m->lock);
+	}
+}
+
+/**
+ * Function for starting the publisher thread. Returns NULL if there is nowhere to publish to.
+ */
+struct metrics* metrics_start(const char* file, const char* socketPath, double interval) {
+	if (file == NULL && socketPath == NULL) return NULL;
+	struct metrics* m = calloc(1, sizeof(struct metrics));
+	if (!m) _exit(1); // Exit if the memory allocation fails
+	m->file = file;
+	m->socketPath = socketPath;
+	m->interval = interval > 0 ? interval : 1.0;
+	m->listenFd = socketPath != NULL ? openSocket(socketPath) : -1;
+	if (m->file == NULL && m->listenFd < 0) {
+		free(m);
+		return NULL;
+	}
+	pthread_mutex_init(&m->lock, NULL);
+	pthread_cond_init(&m->cond, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &m->start);
+	if (pthread_create(&m->thread, NULL, publish, m) != 0) {
+		perror("Error starting metrics thread");
+		if (m->listenFd >= 0) close(m->listenFd);
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+/**
+ * Function for handing the requested snapshot to the publisher (called by the parse thread).
+ */
+void metrics_submit(struct metrics* m, const struct metricsSnapshot* snap) {
+	pthread_mutex_lock(&m->lock);
+	m->snap = *snap;
+	__atomic_store_n(&m->requested, 0, __ATOMIC_RELAXED);
+	pthread_cond_signal(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+}
+
+/**
+ * Function for publishing the final snapshot and stopping the publisher thread.
+ */
+void metrics_stop(struct metrics* m, const struct metricsSnapshot* snap) {
+	if (m == NULL) return;
+	pthread_mutex_lock(&m->lock);
+	m->snap = *snap;
+	m->snap.final = 1;
+	m->stop = 1;
+	pthread_cond_signal(&m->cond);
+	pthread_mutex_unlock(&m->lock);
+	pthread_join(m->thread, NULL);
+	if (m->listenFd >= 0) {
+		close(m->listenFd);
+		unlink(m->socketPath);
+	}
+	pthread_mutex_destroy(&m->lock);
+	pthread_cond_destroy(&m->cond);
+	free(m);
+}
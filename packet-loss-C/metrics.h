@@ -0,0 +1,44 @@
+/**
+ * Periodic snapshots of the progress of a long analysis. The parse thread keeps its counters to itself and only
+ * copies them into a snapshot when the publisher thread asks for one, so a packet costs one relaxed load of the
+ * request flag. The publisher works out the rates, then rewrites the snapshot file (through a rename, so readers
+ * never see a partial snapshot) and hands the snapshot to every client which connects to the Unix socket.
+ */
+
+#define METRICS_SOCKET_POLL 0.1 // Seconds between checks for socket clients
+
+struct metricsSnapshot {
+	double wallTime; // Seconds since the publisher started
+	double traceTime; // Time stamp of the last packet parsed
+	unsigned long packets;
+	unsigned long bytes;
+	long openConns; // -1 if the mode does not keep a connection table
+	unsigned long oosRecords; // Out-of-sequence records buffered
+	unsigned long oosBytes; // Payload bytes of the buffered records
+	unsigned long missingBytes; // Bytes of the gaps opened so far and not filled, including those left when a connection closed
+	double tableLoad; // Live entries per slot of the connection table
+	double tableFill; // Live and deleted entries per slot, the load which probes see
+	double poolLoad; // Out-of-sequence buffer slots in use per slot of the pool
+	int final;
+};
+
+struct metrics {
+	const char* file; // Snapshot file, or NULL
+	const char* socketPath; // Unix socket to serve snapshots on, or NULL
+	double interval; // Seconds between snapshots
+	int listenFd;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int requested; // Set by the publisher, cleared by the parse thread once it has submitted a snapshot
+	int stop;
+	struct timespec start;
+	struct metricsSnapshot snap;
+};
+
+// Returns whether the publisher is waiting for a snapshot (cheap enough to test for every packet)
+#define metrics_wanted(m) ((m) != NULL && __atomic_load_n(&(m)->requested, __ATOMIC_RELAXED))
+
+struct metrics* metrics_start(const char* file, const char* socketPath, double interval);
+void metrics_submit(struct metrics* m, const struct metricsSnapshot* snap);
+void metrics_stop(struct metrics* m, const struct metricsSnapshot* snap);
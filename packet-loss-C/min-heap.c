@@ -1,7 +1,9 @@
 /** Hash table in C, adapted from https://gist.github.com/martinkunev/1365481 */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <unistd.h>
 
 #include "min-heap.h"
 #include "PacketLoss.h"
@@ -0,0 +1,185 @@
+/** Offline sort-then-scan packet loss analysis of a whole trace. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "PacketLoss.h"
+#include "top-k.h"
+#include "packet-batch.h"
+#include "radix-sort.h"
+#include "out-buffer.h"
+#include "report-records.h"
+#include "offline.h"
+
+/**
+ * Function for sorting the records by connection ID, then sequence number. The records are sorted by sequence
+ * number first, then stably by connection ID, so packets with the same sequence number keep their trace order.
+ */
+static void sortRecords(struct packetBatch* b, int threads) {
+	for (unsigned int i = 0; i < b->count; i++) {
+		b->sortKeys[i] = b->seqNum[i];
+		b->order[i] = i;
+	}
+	radix_sort_parallel(b->sortKeys, b->order, b->sortKeysTemp, b->orderTemp, b->count, threads);
+	for (unsigned int i = 0; i < b->count; i++)
+		b->sortKeys[i] = b->connID[b->order[i]];
+	radix_sort_parallel(b->sortKeys, b->order, b->sortKeysTemp, b->orderTemp, b->count, threads);
+}
+
+/**
+ * Function for scanning the sorted records [start, end) of one connection into its report. The result matches
+ * the streaming engine: the connection's first packet in trace order only opens it, packets at the expected
+ * sequence number advance it, packets below it are duplicates, and the first packet beyond it starts the gaps.
+ * Returns 1 if the connection was closed by a FIN in sequence; its later segments are ignored, whereas the streaming
+ * engine reports those it buffered before the FIN came into sequence as gaps of the closed connection.
+ */
+static int scanConnection(struct packetBatch* b, unsigned int start, unsigned int end, struct connReport* report,
+		unsigned long* duplicateCt) {
+	unsigned int first = start;
+	for (unsigned int i = start + 1; i < end; i++)
+		if (b->order[i] < b->order[first]) first = i;
+	report->seqNum = 1;
+	report->timeStamp = b->timeStamp[b->order[first]];
+
+	unsigned int i;
+	for (i = start; i < end; i++) {
+		unsigned int j = b->order[i];
+		if (i == first) continue;
+		if (b->seqNum[j] > report->seqNum) break;
+		if (b->seqNum[j] < report->seqNum) {
+			if (b->payloadSize[j]) (*duplicateCt)++;
+			continue;
+		}
+		report->seqNum = b->seqNum[j] + b->payloadSize[j] + b->fin[j];
+		report->timeStamp = b->timeStamp[j];
+		if (b->fin[j]) return 1;
+	}
+
+	unsigned long lastSeqNum = report->seqNum;
+	for (; i < end; i++) {
+		unsigned int j = b->order[i];
+		if (i == first) continue;
+		if (b->seqNum[j] < lastSeqNum) {
+			// Overlaps data already seen beyond the gap
+			if (b->payloadSize[j]) (*duplicateCt)++;
+			if (b->seqNum[j] + b->payloadSize[j] > lastSeqNum) lastSeqNum = b->seqNum[j] + b->payloadSize[j];
+			continue;
+		}
+		if (b->seqNum[j] != lastSeqNum)
+			report_add_gap(report, lastSeqNum, b->seqNum[j], b->timeStamp[j]);
+		lastSeqNum = b->seqNum[j] + b->payloadSize[j];
+	}
+	return 0;
+}
+
+/**
+ * Function for outputting the summary statistics of the offline analysis, in the format of the exact analysis.
+ */
+void offline_summary(struct packetBatch* records, struct options* opts, unsigned long packetCt, unsigned long byteCt,
+		double lastTimeStamp, const char* outputFilename, struct traceTotals* totals) {
+	FILE *file;
+	file = fopen(outputFilename, "w");
+	if(file == NULL) {
+		perror("Error opening output file");
+		return;
+	}
+
+	puts("\nParse finished! Analysing trace statistics (offline mode)...");
+	int text = opts->format == FORMAT_TEXT;
+	struct outBuffer structured; // Records of a structured report
+	outbuf_init(&structured);
+	if (text) {
+		fputs("======================================================================================\n", file);
+		fprintf(file, "* OUTPUT FROM PACKET LOSS ANALYSIS of %s\n", outputFilename);
+		fputs("======================================================================================\n\n", file);
+	} else
+		emit_header(&structured, opts->format);
+
+	sortRecords(records, opts->threads);
+
+	// Scan each connection's run of records, keeping the reports of the open connections
+	unsigned int reportCt = 0;
+	unsigned int reportSize = 0;
+	struct connReport* reports = NULL;
+	int closedConnCt = 0;
+	unsigned long duplicateCt = 0;
+	for (unsigned int start = 0, end; start < records->count; start = end) {
+		for (end = start + 1; end < records->count && records->sortKeys[end] == records->sortKeys[start]; end++);
+		struct connReport report = {.connID = records->sortKeys[start]};
+		if (scanConnection(records, start, end, &report, &duplicateCt)) {
+			closedConnCt++;
+			free(report.gaps);
+			continue;
+		}
+		if (reportCt == reportSize) {
+			reportSize = reportSize ? reportSize << 1 : 64;
+			reports = realloc(reports, sizeof(struct connReport) * reportSize);
+			if (!reports) _exit(1); // Exit if the memory allocation fails
+		}
+		reports[reportCt++] = report;
+	}
+
+	// Print open connections
+	char ipString[48];
+	struct warningNode* warningHead = NULL;
+	unsigned long totalMissingBytes = 0;
+	if (text) {
+		puts("\nConnections still open:");
+		fputs("\nConnections still open:\n", file);
+	}
+	for (unsigned int i = 0; i < reportCt; i++) {
+		if (text) {
+			IDToString(ipString, reports[i].connID);
+			printf("%s expecting seq num %lu since %.3f\n", ipString, reports[i].seqNum, reports[i].timeStamp);
+			fprintf(file, "%s expecting seq num %lu since %.3f\n", ipString, reports[i].seqNum, reports[i].timeStamp);
+		} else
+			emit_open(&structured, opts->format, reports[i].connID, reports[i].seqNum, reports[i].timeStamp);
+		if (reports[i].timeStamp < lastTimeStamp - 20)
+			updateWarningNodes(&warningHead, reports[i].connID, reports[i].timeStamp, 0L);
+	}
+	if (reportCt == 0 && text) {
+		puts("None.");
+		fputs("None.\n", file);
+	}
+
+	// Print the gaps of each open connection
+	for (unsigned int i = 0; i < reportCt; i++) {
+		if (reports[i].gapCt == 0) continue;
+		if (text) {
+			IDToString(ipString, reports[i].connID);
+			printf("\nBytes missing from %s: \n", ipString);
+			fprintf(file, "\nBytes missing from %s: \n", ipString);
+		}
+		for (unsigned int g = 0; g < reports[i].gapCt; g++) {
+			struct gap* gap = &reports[i].gaps[g];
+			if (text) {
+				printf("%lu missing bytes between seq num %lu and seq num %lu at time %.3f\n",
+						gap->toSeqNum - gap->fromSeqNum, gap->fromSeqNum, gap->toSeqNum, gap->timeStamp);
+				fprintf(file, "%lu missing bytes between seq num %lu and seq num %lu at time %.3f\n",
+						gap->toSeqNum - gap->fromSeqNum, gap->fromSeqNum, gap->toSeqNum, gap->timeStamp);
+			} else
+				emit_gap(&structured, opts->format, reports[i].connID, gap->fromSeqNum, gap->toSeqNum, gap->timeStamp);
+			if (gap->timeStamp < lastTimeStamp - 20)
+				updateWarningNodes(&warningHead, reports[i].connID, gap->timeStamp, gap->toSeqNum - gap->fromSeqNum);
+		}
+		totalMissingBytes += reports[i].bytesMissing;
+		free(reports[i].gaps);
+	}
+	printf("\n%lu duplicate packet(s) ignored.\n", duplicateCt);
+	if (text)
+		fprintf(file, "\n%lu duplicate packet(s) ignored.\n", duplicateCt);
+	outbuf_write(&structured, file);
+	outbuf_term(&structured);
+
+	summaryTotals(file, opts, packetCt, byteCt, closedConnCt + (int) reportCt, (int) reportCt, totalMissingBytes,
+			warningHead, 0, lastTimeStamp, totals);
+	while (warningHead != NULL) {
+		struct warningNode* next = warningHead->next;
+		free(warningHead);
+		warningHead = next;
+	}
+	free(reports);
+	fclose(file);
+}
@@ -0,0 +1,8 @@
+/**
+ * Offline analysis engine for archived traces. Every packet is loaded as a compact record, the records are
+ * sorted by connection and sequence number with a parallel radix sort, and each connection's gaps and
+ * duplicates are found in a single linear scan, without the hash tables and out-of-sequence heaps.
+ */
+
+void offline_summary(struct packetBatch* records, struct options* opts, unsigned long packetCt, unsigned long byteCt,
+		double lastTimeStamp, const char* outputFilename, struct traceTotals* totals);
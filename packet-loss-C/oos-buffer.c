@@ -0,0 +1,199 @@
+/** Out-of-sequence buffers held in a pool of 64-byte slots, overflowing to a 4-ary heap. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "PacketLoss.h"
+#include "dary-heap.h"
+#include "oos-buffer.h"
+
+static const unsigned int base_size = 1024;
+
+// Returns whether record a comes before record b (the order of the heap)
+static int before(const struct oosRecord* a, const struct oosRecord* b) {
+	if (a->seqNum != b->seqNum) return a->seqNum < b->seqNum;
+	return a->timeStamp <= b->timeStamp;
+}
+
+void oos_pool_init(struct oosPool* pool) {
+	*pool = (struct oosPool){
+		.size = base_size,
+		.used = 1,
+		.freeSlot = 0,
+		.slots = calloc(base_size, sizeof(struct oosBuffer))
+	};
+	if (!pool->slots) _exit(1); // Exit if the memory allocation fails
+}
+
+// Frees the pool and any overflow heaps still in it
+void oos_pool_term(struct oosPool* pool) {
+	for (unsigned int i = 1; i < pool->used; i++) {
+		if (pool->slots[i].overflow != NULL) {
+			dheap_term(pool->slots[i].overflow);
+			free(pool->slots[i].overflow);
+		}
+	}
+	free(pool->slots);
+}
+
+// Gives the connection an empty buffer. Growing the pool moves the slots, so buffer pointers are not kept across calls.
+static struct oosBuffer* acquire(struct oosPool* pool, struct connStatus* conn) {
+	uint32_t index = pool->freeSlot;
+	if (index) {
+		pool->freeSlot = pool->slots[index].count;
+	} else {
+		if (pool->used == pool->size) {
+			pool->size <<= 1;
+			pool->slots = realloc(pool->slots, sizeof(struct oosBuffer) * pool->size);
+			if (!pool->slots) _exit(1); // Exit if the memory allocation fails
+		}
+		index = pool->used++;
+	}
+	conn->oosIdx = index;
+	memset(&pool->slots[index], 0, sizeof(struct oosBuffer));
+	pool->slots[index].end = conn->seqNum;
+	pool->buffers++;
+	return &pool->slots[index];
+}
+
+// Adds a record to the pool's totals. A record past the end of the buffer opens a gap before it; one inside the
+// buffer's extent fills a gap (a duplicate of a buffered record is taken as filling one too, making the total low).
+static void account(struct oosPool* pool, struct oosBuffer* b, const struct connStatus* conn, struct oosRecord record) {
+	uint32_t end = record.seqNum + record.payloadSize;
+	pool->records++;
+	pool->bytes += record.payloadSize;
+	if (record.seqNum >= b->end) {
+		pool->missingBytes += record.seqNum - b->end;
+	} else if (record.seqNum >= conn->seqNum) {
+		uint32_t filled = (end < b->end ? end : b->end) - record.seqNum;
+		pool->missingBytes -= filled < pool->missingBytes ? filled : pool->missingBytes;
+	}
+	if (end > b->end) b->end = end;
+}
+
+// Moves the inline records into a newly allocated heap
+static void overflow(struct oosBuffer* b) {
+	b->overflow = malloc(sizeof(struct dheap));
+	if (!b->overflow) _exit(1); // Exit if the memory allocation fails
+	dheap_init(b->overflow);
+	dheap_push_bulk(b->overflow, b->records, b->count);
+	b->count = 0;
+}
+
+/**
+ * Function for adding a record to a connection's buffer. The inline records are kept sorted from the last to
+ * the first in sequence, so the front record is the last one and popping it moves nothing.
+ */
+void oos_push(struct oosPool* pool, struct connStatus* conn, struct oosRecord record) {
+	struct oosBuffer* b = conn->oosIdx ? &pool->slots[conn->oosIdx] : acquire(pool, conn);
+	account(pool, b, conn, record);
+	if (b->overflow == NULL && b->count == OOS_INLINE_RECORDS) overflow(b);
+	if (b->overflow != NULL) {
+		dheap_push(b->overflow, record);
+		return;
+	}
+	unsigned int index;
+	for (index = b->count++; index && before(&b->records[index - 1], &record); index--)
+		b->records[index] = b->records[index - 1];
+	b->records[index] = record;
+}
+
+// Adds several records to a connection's buffer, building the heap in bulk if they overflow it
+void oos_push_bulk(struct oosPool* pool, struct connStatus* conn, const struct oosRecord* records, unsigned int count) {
+	struct oosBuffer* b = conn->oosIdx ? &pool->slots[conn->oosIdx] : acquire(pool, conn);
+	if (b->overflow == NULL && b->count + count > OOS_INLINE_RECORDS) overflow(b);
+	if (b->overflow != NULL) {
+		for (unsigned int i = 0; i < count; i++)
+			account(pool, b, conn, records[i]);
+		dheap_push_bulk(b->overflow, records, count);
+		return;
+	}
+	for (unsigned int i = 0; i < count; i++)
+		oos_push(pool, conn, records[i]);
+}
+
+unsigned int oos_count(struct oosPool* pool, struct connStatus* conn) {
+	if (conn->oosIdx == 0) return 0;
+	struct oosBuffer* b = &pool->slots[conn->oosIdx];
+	return b->overflow ? b->overflow->count : b->count;
+}
+
+// Returns the record with the lowest sequence number (the buffer must not be empty)
+struct oosRecord* oos_front(struct oosPool* pool, struct connStatus* conn) {
+	struct oosBuffer* b = &pool->slots[conn->oosIdx];
+	return b->overflow ? dheap_front(b->overflow) : &b->records[b->count - 1];
+}
+
+static int cmpRecords(const void* a, const void* b) {
+	const struct oosRecord* x = a;
+	const struct oosRecord* y = b;
+	if (x->seqNum != y->seqNum) return x->seqNum < y->seqNum ? -1 : 1;
+	if (x->timeStamp != y->timeStamp) return x->timeStamp < y->timeStamp ? -1 : 1;
+	return (x->payloadSize > y->payloadSize) - (x->payloadSize < y->payloadSize);
+}
+
+// Copies a connection's records into out (which must hold oos_count() records) in the order oos_pop() would
+// remove them, leaving the buffer as it is. Used where several threads read the pool at once.
+void oos_copy_sorted(struct oosPool* pool, struct connStatus* conn, struct oosRecord* out) {
+	if (conn->oosIdx == 0) return;
+	struct oosBuffer* b = &pool->slots[conn->oosIdx];
+	if (b->overflow != NULL) {
+		memcpy(out, b->overflow->data, sizeof(struct oosRecord) * b->overflow->count);
+		qsort(out, b->overflow->count, sizeof(struct oosRecord), cmpRecords);
+	} else {
+		for (unsigned int i = 0; i < b->count; i++)
+			out[i] = b->records[b->count - 1 - i];
+	}
+}
+
+/**
+ * Function for moving a connection's next expected sequence number on. Bytes which arrive in sequence before the
+ * front record fill the gap in front of it.
+ */
+void oos_advance(struct oosPool* pool, struct connStatus* conn, uint32_t seqNum) {
+	if (conn->oosIdx && seqNum > conn->seqNum) {
+		uint32_t front = oos_front(pool, conn)->seqNum;
+		if (front > conn->seqNum) {
+			uint32_t filled = (seqNum < front ? seqNum : front) - conn->seqNum;
+			pool->missingBytes -= filled < pool->missingBytes ? filled : pool->missingBytes;
+		}
+	}
+	conn->seqNum = seqNum;
+}
+
+// Removes the front record; a buffer which empties goes back to the pool
+void oos_pop(struct oosPool* pool, struct connStatus* conn) {
+	struct oosBuffer* b = &pool->slots[conn->oosIdx];
+	pool->records--;
+	pool->bytes -= oos_front(pool, conn)->payloadSize;
+	if (b->overflow != NULL) {
+		dheap_pop(b->overflow);
+		if (b->overflow->count == 0) oos_clear(pool, conn);
+	} else if (--b->count == 0) {
+		oos_clear(pool, conn);
+	}
+}
+
+// Empties a connection's buffer, freeing its heap and returning its slot to the pool. Gaps still open in it stay
+// in the missing total, as they were never filled.
+void oos_clear(struct oosPool* pool, struct connStatus* conn) {
+	if (conn->oosIdx == 0) return;
+	struct oosBuffer* b = &pool->slots[conn->oosIdx];
+	const struct oosRecord* records = b->overflow ? b->overflow->data : b->records;
+	unsigned int count = b->overflow ? b->overflow->count : b->count;
+	for (unsigned int i = 0; i < count; i++)
+		pool->bytes -= records[i].payloadSize;
+	pool->records -= count;
+	pool->buffers--;
+	if (b->overflow != NULL) {
+		dheap_term(b->overflow);
+		free(b->overflow);
+		b->overflow = NULL;
+	}
+	b->count = pool->freeSlot;
+	pool->freeSlot = conn->oosIdx;
+	conn->oosIdx = 0;
+}
@@ -0,0 +1,29 @@
+/**
+ * Per-connection buffers of out-of-sequence packet records. Connections rarely hold more than a few records at
+ * a time, so each buffer holds a few records inline in a slot of a shared pool; only a buffer which overflows
+ * allocates a heap. A connection only holds a slot while its buffer is not empty. The pool keeps running totals of
+ * the buffered records and of the bytes missing before them, so they can be read without visiting any buffer.
+ */
+
+struct oosPool
+{
+	unsigned int size; // Size of the allocated memory (in number of slots)
+	unsigned int used; // Slots handed out so far (slot 0 is never used, so an index of 0 means no buffer)
+	uint32_t freeSlot; // First slot of the list of released slots, chained through their count fields
+	struct oosBuffer* slots;
+	unsigned int buffers; // Buffers holding records
+	unsigned long records; // Records held in every buffer
+	unsigned long bytes; // Payload bytes of those records
+	unsigned long missingBytes; // Bytes of the gaps opened before buffered records and not filled since
+};
+
+void oos_pool_init(struct oosPool* pool);
+void oos_pool_term(struct oosPool* pool);
+void oos_push(struct oosPool* pool, struct connStatus* conn, struct oosRecord record);
+void oos_push_bulk(struct oosPool* pool, struct connStatus* conn, const struct oosRecord* records, unsigned int count);
+unsigned int oos_count(struct oosPool* pool, struct connStatus* conn);
+struct oosRecord* oos_front(struct oosPool* pool, struct connStatus* conn);
+void oos_copy_sorted(struct oosPool* pool, struct connStatus* conn, struct oosRecord* out);
+void oos_advance(struct oosPool* pool, struct connStatus* conn, uint32_t seqNum);
+void oos_pop(struct oosPool* pool, struct connStatus* conn);
+void oos_clear(struct oosPool* pool, struct connStatus* conn);
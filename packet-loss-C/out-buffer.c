@@ -0,0 +1,46 @@
+/** Growable text buffer for formatting report sections in memory. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#include "out-buffer.h"
+
+static const size_t base_size = 4096;
+
+void outbuf_init(struct outBuffer* b) {
+	*b = (struct outBuffer){
+		.data = malloc(base_size),
+		.len = 0,
+		.size = base_size
+	};
+	if (!b->data) _exit(1); // Exit if the memory allocation fails
+	b->data[0] = 0;
+}
+
+// Appends formatted text, doubling the buffer until it fits
+void outbuf_printf(struct outBuffer* b, const char* format, ...) {
+	va_list args;
+	while (1) {
+		va_start(args, format);
+		int len = vsnprintf(b->data + b->len, b->size - b->len, format, args);
+		va_end(args);
+		if (len < 0) return;
+		if (b->len + (size_t) len < b->size) {
+			b->len += (size_t) len;
+			return;
+		}
+		b->size <<= 1;
+		b->data = realloc(b->data, b->size);
+		if (!b->data) _exit(1); // Exit if the memory allocation fails
+	}
+}
+
+void outbuf_write(const struct outBuffer* b, FILE* file) {
+	fwrite(b->data, 1, b->len, file);
+}
+
+void outbuf_term(struct outBuffer* b) {
+	free(b->data);
+}
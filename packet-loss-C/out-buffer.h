@@ -0,0 +1,14 @@
+/**
+ * Growable in-memory text buffer, so report sections can be formatted (in parallel) before one large write each.
+ */
+
+struct outBuffer {
+	char* data;
+	size_t len;
+	size_t size; // Size of the allocated memory (in bytes)
+};
+
+void outbuf_init(struct outBuffer* b);
+void outbuf_printf(struct outBuffer* b, const char* format, ...) __attribute__((format(printf, 2, 3)));
+void outbuf_write(const struct outBuffer* b, FILE* file);
+void outbuf_term(struct outBuffer* b);
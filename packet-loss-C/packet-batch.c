@@ -0,0 +1,100 @@
+/** Struct-of-arrays packet batches, sorted by connection ID so each connection's packets are processed together. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "PacketLoss.h"
+#include "packet-batch.h"
+#include "radix-sort.h"
+
+// Prepares a batch of the given size for use
+void batch_init(struct packetBatch* b, unsigned int size)
+{
+	*b = (struct packetBatch){
+		.size = size,
+		.count = 0,
+		.connID = malloc(sizeof(uint64_t) * size),
+		.seqNum = malloc(sizeof(uint32_t) * size),
+		.payloadSize = malloc(sizeof(uint32_t) * size),
+		.timeStamp = malloc(sizeof(double) * size),
+		.syn = malloc(size),
+		.fin = malloc(size),
+		.order = malloc(sizeof(unsigned int) * size),
+		.sortKeys = malloc(sizeof(uint64_t) * size),
+		.sortKeysTemp = malloc(sizeof(uint64_t) * size),
+		.orderTemp = malloc(sizeof(unsigned int) * size)
+	};
+	if (!b->connID || !b->seqNum || !b->payloadSize || !b->timeStamp || !b->syn || !b->fin
+			|| !b->order || !b->sortKeys || !b->sortKeysTemp || !b->orderTemp) _exit(1); // Exit if the memory allocation fails
+}
+
+// Doubles the size of the batch, keeping its packets
+void batch_grow(struct packetBatch* b)
+{
+	b->size <<= 1;
+	b->connID = realloc(b->connID, sizeof(uint64_t) * b->size);
+	b->seqNum = realloc(b->seqNum, sizeof(uint32_t) * b->size);
+	b->payloadSize = realloc(b->payloadSize, sizeof(uint32_t) * b->size);
+	b->timeStamp = realloc(b->timeStamp, sizeof(double) * b->size);
+	b->syn = realloc(b->syn, b->size);
+	b->fin = realloc(b->fin, b->size);
+	b->order = realloc(b->order, sizeof(unsigned int) * b->size);
+	b->sortKeys = realloc(b->sortKeys, sizeof(uint64_t) * b->size);
+	b->sortKeysTemp = realloc(b->sortKeysTemp, sizeof(uint64_t) * b->size);
+	b->orderTemp = realloc(b->orderTemp, sizeof(unsigned int) * b->size);
+	if (!b->connID || !b->seqNum || !b->payloadSize || !b->timeStamp || !b->syn || !b->fin
+			|| !b->order || !b->sortKeys || !b->sortKeysTemp || !b->orderTemp) _exit(1); // Exit if the memory allocation fails
+}
+
+// Appends a packet to the batch (which must not be full)
+void batch_push(struct packetBatch* b, struct packet p)
+{
+	unsigned int i = b->count++;
+	b->connID[i] = p.connID;
+	b->seqNum[i] = (uint32_t) p.seqNum;
+	b->payloadSize[i] = (uint32_t) p.payloadSize;
+	b->timeStamp[i] = p.timeStamp;
+	b->syn[i] = (unsigned char) p.syn;
+	b->fin[i] = (unsigned char) p.fin;
+}
+
+// Orders the batch by connection ID. The sort is stable, so each connection's packets stay in trace order.
+void batch_sort(struct packetBatch* b)
+{
+	for (unsigned int i = 0; i < b->count; i++) {
+		b->sortKeys[i] = b->connID[i];
+		b->order[i] = i;
+	}
+	radix_sort(b->sortKeys, b->order, b->sortKeysTemp, b->orderTemp, b->count);
+}
+
+// Returns the i-th packet of the batch in sorted order
+struct packet batch_get(struct packetBatch* b, unsigned int i)
+{
+	unsigned int j = b->order[i];
+	return (struct packet){
+		.seqNum = b->seqNum[j],
+		.timeStamp = b->timeStamp[j],
+		.payloadSize = b->payloadSize[j],
+		.syn = b->syn[j],
+		.fin = b->fin[j],
+		.connID = b->connID[j]
+	};
+}
+
+// Frees the allocated memory
+void batch_term(struct packetBatch* b)
+{
+	free(b->connID);
+	free(b->seqNum);
+	free(b->payloadSize);
+	free(b->timeStamp);
+	free(b->syn);
+	free(b->fin);
+	free(b->order);
+	free(b->sortKeys);
+	free(b->sortKeysTemp);
+	free(b->orderTemp);
+}
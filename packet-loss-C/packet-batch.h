@@ -0,0 +1,32 @@
+/**
+ * Block of parsed packets stored as struct-of-arrays columns, which can be grouped by connection with a
+ * stable radix sort before the packets are processed.
+ */
+struct packetBatch
+{
+	unsigned int size; // Size of the allocated columns (in number of packets)
+	unsigned int count; // Count of the packets in the batch
+	uint64_t* connID;
+	uint32_t* seqNum; // Relative sequence numbers, which fit in 32 bits
+	uint32_t* payloadSize;
+	double* timeStamp;
+	unsigned char* syn;
+	unsigned char* fin;
+	unsigned int* order; // Positions of the packets, in connection order once sorted
+	uint64_t* sortKeys; // Scratch space for the radix sort
+	uint64_t* sortKeysTemp;
+	unsigned int* orderTemp;
+};
+
+void batch_init(struct packetBatch* b, unsigned int size);
+void batch_grow(struct packetBatch* b);
+void batch_push(struct packetBatch* b, struct packet p);
+void batch_sort(struct packetBatch* b);
+struct packet batch_get(struct packetBatch* b, unsigned int i);
+void batch_term(struct packetBatch* b);
+
+// Returns whether the batch is full
+#define batch_full(b) ((b)->count == (b)->size)
+
+// Empties the batch for reuse
+#define batch_clear(b) ((b)->count = 0)
@@ -0,0 +1,123 @@
+/** Trace packet reader: column layout, line splitting, filtering and decoding. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "PacketLoss.h"
+#include "trace-reader.h"
+#include "schema.h"
+#include "filter.h"
+#include "packet-reader.h"
+
+/**
+ * Function for finding the column layout of a trace: from its header line if it starts with one (which is skipped),
+ * else from the columns file given on the command line, else the full tshark profile.
+ */
+int readSchema(struct traceReader* trace, struct options* opts, struct schema* schema) {
+	int c = trace_getc(trace);
+	if (c != EOF && !isdigit(c)) {
+		char header[4096];
+		int len = 0;
+		while (c != '\n' && c != EOF) {
+			if (c != '\r' && len < (int) sizeof header - 1) header[len++] = (char) c;
+			c = trace_getc(trace);
+		}
+		header[len] = 0;
+		if (!schema_parse(schema, header, "\t")) return 0;
+	} else {
+		if (c != EOF) trace_unget(trace);
+		if (opts->columnsFile != NULL) {
+			if (!schema_load(schema, opts->columnsFile)) return 0;
+		} else {
+			*schema = schemaFull;
+		}
+	}
+	printf("Reading the trace as the %s.\n", schema->name);
+	return 1;
+}
+
+/**
+ * Function for opening a trace for reading its packets. Returns NULL if the trace cannot be opened or its layout
+ * lacks a field.
+ */
+struct packetReader* reader_open(const char* filename, struct options* opts) {
+	struct traceReader* trace = trace_open(filename);
+	if (trace == NULL)
+		return NULL;
+	return reader_new(trace, NULL, opts);
+}
+
+/**
+ * Function for reading the packets of an open trace, which the reader takes over. The layout is found from the trace
+ * unless it is given (for parts of a trace whose layout is already known). Returns NULL if the layout lacks a field.
+ */
+struct packetReader* reader_new(struct traceReader* trace, const struct schema* schema, struct options* opts) {
+	struct packetReader* r = calloc(1, sizeof(struct packetReader));
+	if (!r) _exit(1); // Exit if the memory allocation fails
+	r->trace = trace;
+	if (schema != NULL) {
+		r->schema = *schema;
+	} else if (!readSchema(trace, opts, &r->schema)) {
+		trace_close(trace);
+		free(r);
+		return NULL;
+	}
+	if (opts->filter != NULL) {
+		r->filter = *opts->filter;
+		r->filtered = 1;
+		filter_bind(&r->filter, &r->schema);
+	}
+	return r;
+}
+
+/**
+ * Function for reading the next line of the trace which passes the filter into r->packet. Sets dataComplete to 0
+ * if a connection field of the line is empty. Returns 0 at the end of the trace.
+ */
+int reader_next(struct packetReader* r, int* dataComplete) {
+	int lineCt = 0;
+	int charCt = 0;
+	int keep = r->schema.used & 1; // Whether the column being read holds a field
+	r->lineOffset = trace_offset(r->trace);
+	while (1) {
+		int c = trace_getc(r->trace);
+		if (c == EOF)
+			return 0;
+		if (c == '\n' || c == '\t') {
+			if (keep)
+				r->fields[lineCt][charCt] = 0;
+			// Reject a line at the first column which fails the filter, and skip the rest of it without decoding
+			if (keep && r->filtered && !filter_pass(&r->filter, lineCt, r->fields[lineCt], charCt)) {
+				while (c != '\n' && c != EOF)
+					c = trace_getc(r->trace);
+				r->filteredCt++;
+				if (c == EOF)
+					return 0;
+				lineCt = 0;
+				charCt = 0;
+				keep = r->schema.used & 1;
+				r->lineOffset = trace_offset(r->trace);
+				continue;
+			}
+			if (c == '\n') {
+				*dataComplete = r->schema.decode(&r->schema, r->fields, lineCt, &r->packet, &r->connection, &r->byteCt);
+				return 1;
+			}
+			lineCt += 1;
+			charCt = 0;
+			keep = lineCt < MAX_COLUMNS && (r->schema.used >> lineCt & 1);
+		} else if (keep && charCt < FIELD_SIZE - 1) {
+			r->fields[lineCt][charCt++] = c;
+		}
+	}
+}
+
+void reader_close(struct packetReader* r) {
+	trace_close(r->trace);
+	free(r);
+}
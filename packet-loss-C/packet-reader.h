@@ -0,0 +1,22 @@
+/**
+ * Reader of the packets of a trace: finds the trace's column layout, splits each line into the columns which hold
+ * fields, drops the lines which fail the filter as soon as a column fails it, and decodes the rest.
+ */
+
+struct packetReader {
+	struct traceReader* trace;
+	struct schema schema;
+	struct filter filter; // Copy of the filter bound to this trace's layout
+	int filtered; // Whether there is a filter
+	char fields[MAX_COLUMNS][FIELD_SIZE]; // Raw text of the columns of the current line which hold fields
+	struct packet packet; // Last packet read (fields missing from a short line keep their previous values)
+	struct connection connection;
+	unsigned long byteCt; // Payload bytes of the packets read so far
+	int filteredCt; // Lines dropped by the filter
+	off_t lineOffset; // Position in the trace of the last line read
+};
+
+struct packetReader* reader_open(const char* filename, struct options* opts);
+struct packetReader* reader_new(struct traceReader* trace, const struct schema* schema, struct options* opts);
+int reader_next(struct packetReader* r, int* dataComplete);
+void reader_close(struct packetReader* r);
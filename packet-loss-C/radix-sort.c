@@ -0,0 +1,203 @@
+/** Stable least significant digit radix sort on 64-bit keys, 8 bits per pass. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "radix-sort.h"
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PARALLEL_MIN 65536 // Fewer keys than this are sorted on one thread
+
+/**
+ * Function for sorting keys (and the index carried with each key) in ascending order. Equal keys keep their
+ * relative order. The temporary arrays must hold count elements; the result ends up in keys and index.
+ * Passes over a digit which is the same for every key are skipped, so keys with few distinct high bits
+ * (such as connection IDs) sort in fewer passes. Returns the count of passes done.
+ */
+int radix_sort(uint64_t* keys, unsigned int* index, uint64_t* keysTemp, unsigned int* indexTemp, unsigned int count) {
+	unsigned int histogram[64 / RADIX_BITS][RADIX_BUCKETS];
+	memset(histogram, 0, sizeof histogram);
+
+	// Count every digit in a single pass over the keys
+	for (unsigned int i = 0; i < count; i++) {
+		uint64_t key = keys[i];
+		for (int pass = 0; pass < 64 / RADIX_BITS; pass++)
+			histogram[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+	}
+
+	int passes = 0;
+	uint64_t* srcKeys = keys;
+	unsigned int* srcIndex = index;
+	uint64_t* dstKeys = keysTemp;
+	unsigned int* dstIndex = indexTemp;
+	for (int pass = 0; pass < 64 / RADIX_BITS; pass++) {
+		unsigned int* counts = histogram[pass];
+		int shift = pass * RADIX_BITS;
+		if (count == 0 || counts[(srcKeys[0] >> shift) & (RADIX_BUCKETS - 1)] == count) continue; // Every key has the same digit
+		passes++;
+
+		// Turn the counts into starting offsets
+		unsigned int offset = 0;
+		for (int b = 0; b < RADIX_BUCKETS; b++) {
+			unsigned int c = counts[b];
+			counts[b] = offset;
+			offset += c;
+		}
+		for (unsigned int i = 0; i < count; i++) {
+			unsigned int pos = counts[(srcKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+			dstKeys[pos] = srcKeys[i];
+			dstIndex[pos] = srcIndex[i];
+		}
+
+		uint64_t* tmpKeys = srcKeys;
+		srcKeys = dstKeys;
+		dstKeys = tmpKeys;
+		unsigned int* tmpIndex = srcIndex;
+		srcIndex = dstIndex;
+		dstIndex = tmpIndex;
+	}
+
+	// Copy back if the last pass left the result in the temporary arrays
+	if (srcKeys != keys) {
+		memcpy(keys, srcKeys, sizeof(uint64_t) * count);
+		memcpy(index, srcIndex, sizeof(unsigned int) * count);
+	}
+	return passes;
+}
+
+
+struct radixShared {
+	uint64_t* keys[2]; // Source and destination of each pass swap between [0] and [1]
+	unsigned int* index[2];
+	unsigned int count;
+	int threads;
+	unsigned int (*histogram)[RADIX_BUCKETS]; // One histogram per thread
+	int skip; // Set when every key has the same digit in this pass
+	int passes; // Passes done (not skipped), so the caller knows where the result is
+	pthread_barrier_t barrier;
+	pthread_mutex_t start; // Held while the threads are started, until threads and barrier are final
+};
+
+struct radixWorker {
+	struct radixShared* shared;
+	int id;
+};
+
+/**
+ * Function run by each thread of the parallel sort. Each pass has three phases separated by barriers: every
+ * thread counts the digits in its own slice of the keys, thread 0 turns the counts into offsets (bucket by
+ * bucket, then thread by thread, which keeps the sort stable), and every thread scatters its slice. A pass is skipped
+ * when one bucket holds every key once the counts of all the threads are added up.
+ */
+static void* radix_worker(void* arg) {
+	struct radixWorker* worker = arg;
+	struct radixShared* shared = worker->shared;
+	pthread_mutex_lock(&shared->start); // Wait until every thread that could be started is known
+	pthread_mutex_unlock(&shared->start);
+	unsigned int start = (unsigned int) ((uint64_t) shared->count * worker->id / shared->threads);
+	unsigned int end = (unsigned int) ((uint64_t) shared->count * (worker->id + 1) / shared->threads);
+	int src = 0;
+
+	for (int pass = 0; pass < 64 / RADIX_BITS; pass++) {
+		int shift = pass * RADIX_BITS;
+		unsigned int* counts = shared->histogram[worker->id];
+		uint64_t* srcKeys = shared->keys[src];
+		unsigned int* srcIndex = shared->index[src];
+		uint64_t* dstKeys = shared->keys[1 - src];
+		unsigned int* dstIndex = shared->index[1 - src];
+
+		memset(counts, 0, sizeof(unsigned int) * RADIX_BUCKETS);
+		for (unsigned int i = start; i < end; i++)
+			counts[(srcKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+		pthread_barrier_wait(&shared->barrier);
+
+		if (worker->id == 0) {
+			unsigned int offset = 0;
+			shared->skip = 0;
+			for (int b = 0; b < RADIX_BUCKETS && !shared->skip; b++) {
+				unsigned int total = 0;
+				for (int t = 0; t < shared->threads; t++)
+					total += shared->histogram[t][b];
+				if (total == shared->count) shared->skip = 1; // Every key has the same digit
+			}
+			for (int b = 0; b < RADIX_BUCKETS && !shared->skip; b++) {
+				for (int t = 0; t < shared->threads; t++) {
+					unsigned int c = shared->histogram[t][b];
+					shared->histogram[t][b] = offset;
+					offset += c;
+				}
+			}
+			if (!shared->skip) shared->passes++;
+		}
+		pthread_barrier_wait(&shared->barrier);
+		if (shared->skip) continue; // Every thread sees the same flag, so all of them skip the scatter
+
+		for (unsigned int i = start; i < end; i++) {
+			unsigned int pos = counts[(srcKeys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+			dstKeys[pos] = srcKeys[i];
+			dstIndex[pos] = srcIndex[i];
+		}
+		src = 1 - src;
+		pthread_barrier_wait(&shared->barrier);
+	}
+	return NULL;
+}
+
+/**
+ * Function for sorting keys (and the index carried with each key) on several threads, with the same result as
+ * radix_sort(). Falls back to radix_sort() for small inputs or a single thread. If some threads cannot be
+ * created, the keys are split between the threads which were started (and the calling thread) instead.
+ * Returns the count of passes done, which is the same as radix_sort() would do.
+ */
+int radix_sort_parallel(uint64_t* keys, unsigned int* index, uint64_t* keysTemp, unsigned int* indexTemp, unsigned int count,
+		int threads) {
+	if (threads <= 1 || count < RADIX_PARALLEL_MIN)
+		return radix_sort(keys, index, keysTemp, indexTemp, count);
+
+	struct radixShared shared = {
+		.keys = {keys, keysTemp},
+		.index = {index, indexTemp},
+		.count = count,
+		.threads = threads,
+		.histogram = malloc(sizeof(unsigned int) * RADIX_BUCKETS * threads),
+		.skip = 0,
+		.passes = 0
+	};
+	pthread_t* tids = malloc(sizeof(pthread_t) * threads);
+	struct radixWorker* workers = malloc(sizeof(struct radixWorker) * threads);
+	if (!shared.histogram || !tids || !workers) _exit(1); // Exit if the memory allocation fails
+	pthread_mutex_init(&shared.start, NULL);
+	pthread_mutex_lock(&shared.start);
+
+	int started = 1; // The calling thread is worker 0
+	while (started < threads) {
+		workers[started] = (struct radixWorker){&shared, started};
+		if (pthread_create(&tids[started], NULL, radix_worker, &workers[started]) != 0)
+			break;
+		started++;
+	}
+	shared.threads = started;
+	pthread_barrier_init(&shared.barrier, NULL, started);
+	pthread_mutex_unlock(&shared.start);
+
+	workers[0] = (struct radixWorker){&shared, 0};
+	radix_worker(&workers[0]);
+	for (int t = 1; t < started; t++)
+		pthread_join(tids[t], NULL);
+
+	// Copy back if an odd number of passes left the result in the temporary arrays
+	if (shared.passes % 2) {
+		memcpy(keys, keysTemp, sizeof(uint64_t) * count);
+		memcpy(index, indexTemp, sizeof(unsigned int) * count);
+	}
+	pthread_barrier_destroy(&shared.barrier);
+	pthread_mutex_destroy(&shared.start);
+	free(shared.histogram);
+	free(tids);
+	free(workers);
+	return shared.passes;
+}
@@ -0,0 +1,8 @@
+/**
+ * Stable LSD radix sort of 64-bit keys, carrying a 32-bit index (such as a packet's position in its batch)
+ * along with each key. Both sorts return the count of passes they did.
+ */
+
+int radix_sort(uint64_t* keys, unsigned int* index, uint64_t* keysTemp, unsigned int* indexTemp, unsigned int count);
+int radix_sort_parallel(uint64_t* keys, unsigned int* index, uint64_t* keysTemp, unsigned int* indexTemp, unsigned int count,
+		int threads);
@@ -0,0 +1,338 @@
+/**
+ * Paced replay of a trace into the analyser, to measure how soon it reports losses when run live. The trace is
+ * written into a pipe which the analyser reads as its standard input, each packet line when its time stamp falls due:
+ * at the trace's own pace, a multiple of it, or as fast as the analyser takes them. The analyser stamps each gap it
+ * detects (-events), and the latency from the packet which opened the gap being written to its detection is reported
+ * with how far the replay fell behind its schedule.
+ * Build in packet-loss-C/replay with: gcc -O2 -o trace-replay trace-replay.c -lz
+ * Run: ./trace-replay [-speed X] [-lag S] [-time COLUMN] TRACE ANALYSER [ANALYSER OPTIONS...]
+ * e.g. ./trace-replay -speed 10 ../trace.txt ../PacketLoss
+ * -speed X   replay X times faster than the trace (default 1, its own pace; 0 as fast as possible)
+ * -lag S     seconds behind schedule from which the replay has fallen behind (default 0.1)
+ * -time N    column (from 0) of the time stamps in a trace without a header line (default 1, as in the full profile)
+ * The analyser's terminal output is discarded; its report is written as usual, to stdin-PacketLoss.txt.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <zlib.h>
+
+#define REPLAY_LINE_SIZE 65536
+#define REPLAY_WRITE_SIZE 65536 // Lines already due are written together, up to this many bytes
+#define REPLAY_WINDOW 0.1 // Seconds of schedule over which the packet rate is measured
+
+/**
+ * Packets replayed so far: each one's time stamp and when its line was written into the pipe.
+ */
+struct replayLog {
+	unsigned long count;
+	unsigned long size; // Size of the allocated memory (in number of packets)
+	double* traceTime; // Time stamps, kept non-decreasing so that they can be searched
+	int64_t* writeNs;
+};
+
+static int64_t nowNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void logPacket(struct replayLog* log, double traceTime) {
+	if (log->count == log->size) {
+		log->size = log->size ? log->size << 1 : 65536;
+		log->traceTime = realloc(log->traceTime, sizeof(double) * log->size);
+		log->writeNs = realloc(log->writeNs, sizeof(int64_t) * log->size);
+		if (!log->traceTime || !log->writeNs) _exit(1); // Exit if the memory allocation fails
+	}
+	if (log->count && traceTime < log->traceTime[log->count - 1])
+		traceTime = log->traceTime[log->count - 1]; // A packet out of time order is sent when it is read
+	log->traceTime[log->count++] = traceTime;
+}
+
+// Returns the time stamp in the given column of a line
+static double lineTime(const char* line, int column) {
+	for (int c = 0; c < column && line != NULL; c++) {
+		line = strchr(line, '\t');
+		if (line != NULL) line++;
+	}
+	return line != NULL ? atof(line) : 0;
+}
+
+// Returns the column of the time stamp named in a header line (as in schema.c), or -1 if there is none
+static int headerTimeColumn(char* line) {
+	int column = 0;
+	for (char* name = strtok(line, "\t\r\n"); name != NULL; name = strtok(NULL, "\t\r\n"), column++)
+		if (strcmp(name, "frame.time_relative") == 0 || strcmp(name, "frame.time_epoch") == 0)
+			return column;
+	return -1;
+}
+
+/**
+ * Function for writing all of a buffer into the pipe, stamping its packets (from firstPacket up to endPacket) with
+ * the time the write finished. Returns 0 if the analyser has stopped reading.
+ */
+static int writeLines(int fd, const char* data, size_t len, struct replayLog* log, unsigned long firstPacket,
+		unsigned long endPacket) {
+	while (len) {
+		ssize_t n = write(fd, data, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0) {
+			perror("Error writing to the analyser");
+			return 0;
+		}
+		data += n;
+		len -= (size_t) n;
+	}
+	int64_t now = nowNs();
+	for (unsigned long i = firstPacket; i < endPacket; i++)
+		log->writeNs[i] = now;
+	return 1;
+}
+
+/**
+ * Function for starting the analyser on the read end of a pipe, with its events stamped in eventsFile. Returns the
+ * write end of the pipe, or -1 if the analyser cannot be started.
+ */
+static int startAnalyser(char** args, int argCt, const char* eventsFile, pid_t* pid) {
+	int fds[2];
+	if (pipe(fds) != 0) {
+		perror("Error creating pipe");
+		return -1;
+	}
+	char** argv = malloc(sizeof(char*) * (argCt + 4));
+	if (!argv) _exit(1); // Exit if the memory allocation fails
+	memcpy(argv, args, sizeof(char*) * argCt);
+	argv[argCt] = "-events";
+	argv[argCt + 1] = (char*) eventsFile;
+	argv[argCt + 2] = "-";
+	argv[argCt + 3] = NULL;
+	*pid = fork();
+	if (*pid == 0) {
+		dup2(fds[0], STDIN_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		int devNull = open("/dev/null", O_WRONLY);
+		if (devNull >= 0) dup2(devNull, STDOUT_FILENO);
+		execvp(argv[0], argv);
+		perror("Error starting the analyser");
+		_exit(127);
+	}
+	free(argv);
+	close(fds[0]);
+	if (*pid < 0) {
+		perror("Error starting the analyser");
+		close(fds[1]);
+		return -1;
+	}
+	return fds[1];
+}
+
+static int cmpLatencies(const void* a, const void* b) {
+	int64_t x = *(const int64_t*) a, y = *(const int64_t*) b;
+	return (x > y) - (x < y);
+}
+
+// Returns the p quantile of sorted latencies, in ms
+static double quantile(const int64_t* latencies, unsigned long count, double p) {
+	unsigned long i = (unsigned long) (p * count + 0.999999);
+	return latencies[i ? i - 1 : 0] / 1e6;
+}
+
+/**
+ * Function for reporting the latency from each gap's packet being written to the gap being detected. The packet
+ * is found by its time stamp, the first one written with the time stamp of the event.
+ */
+static void detectionLatency(const char* eventsFile, const struct replayLog* log) {
+	FILE* events = fopen(eventsFile, "r");
+	if (events == NULL) {
+		perror("Error opening events file");
+		return;
+	}
+	int64_t* latencies = NULL;
+	unsigned long count = 0, size = 0;
+	char line[256];
+	while (fgets(line, sizeof line, events) != NULL) {
+		double traceTime;
+		long long detectNs;
+		if (sscanf(line, "gap %*s %lf %*u %*u %lld", &traceTime, &detectNs) != 2 || log->count == 0)
+			continue;
+		unsigned long lo = 0, hi = log->count - 1;
+		while (lo < hi) {
+			unsigned long mid = lo + (hi - lo) / 2;
+			if (log->traceTime[mid] < traceTime) lo = mid + 1;
+			else hi = mid;
+		}
+		if (count == size) {
+			size = size ? size << 1 : 1024;
+			latencies = realloc(latencies, sizeof(int64_t) * size);
+			if (!latencies) _exit(1); // Exit if the memory allocation fails
+		}
+		int64_t latency = detectNs - log->writeNs[lo];
+		latencies[count++] = latency > 0 ? latency : 0;
+	}
+	fclose(events);
+	if (count == 0) {
+		puts("No gaps detected.");
+		return;
+	}
+	qsort(latencies, count, sizeof(int64_t), cmpLatencies);
+	printf("Detection latency of %lu gaps: p50 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms\n", count,
+			quantile(latencies, count, 0.5), quantile(latencies, count, 0.99), quantile(latencies, count, 0.999),
+			latencies[count - 1] / 1e6);
+	free(latencies);
+}
+
+int main(int argc, char *argv[]) {
+	double speed = 1.0;
+	double lagLimit = 0.1;
+	int timeColumn = 1;
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-speed") == 0 && i + 1 < argc) speed = atof(argv[++i]);
+		else if (strcmp(argv[i], "-lag") == 0 && i + 1 < argc) lagLimit = atof(argv[++i]);
+		else if (strcmp(argv[i], "-time") == 0 && i + 1 < argc) timeColumn = atoi(argv[++i]);
+		else break;
+	}
+	if (argc - i < 2) {
+		printf("Usage: %s [-speed X] [-lag S] [-time COLUMN] TRACE ANALYSER [ANALYSER OPTIONS...]\n", argv[0]);
+		return 1;
+	}
+	const char* traceFile = argv[i];
+	gzFile trace = gzopen(traceFile, "rb");
+	if (trace == NULL) {
+		perror("Error opening file");
+		return 1;
+	}
+	gzbuffer(trace, 1 << 20);
+
+	char eventsFile[] = "/tmp/trace-replay-XXXXXX";
+	int eventsFd = mkstemp(eventsFile);
+	if (eventsFd < 0) {
+		perror("Error creating events file");
+		return 1;
+	}
+	close(eventsFd);
+	signal(SIGPIPE, SIG_IGN); // An analyser which stops reading shows up as a failed write
+	pid_t pid;
+	int out = startAnalyser(argv + i + 1, argc - i - 1, eventsFile, &pid);
+	if (out < 0) {
+		unlink(eventsFile);
+		return 1;
+	}
+
+	char* line = malloc(REPLAY_LINE_SIZE);
+	char* pending = malloc(REPLAY_WRITE_SIZE + REPLAY_LINE_SIZE);
+	if (!line || !pending) _exit(1); // Exit if the memory allocation fails
+	size_t pendingLen = 0;
+	unsigned long pendingFirst = 0; // First packet of the pending lines
+	struct replayLog log = {0};
+	int64_t start = nowNs();
+	double firstTime = 0;
+	int64_t maxLag = 0;
+	unsigned long behindAt = 0; // Packet from which the replay was behind schedule (+1), or 0
+	int64_t behindNs = 0;
+	double windowStart = 0; // Rate over REPLAY_WINDOW of schedule: packets in the current window, and the most kept up with
+	unsigned long windowCt = 0, bestWindowCt = 0;
+	int64_t windowLag = 0;
+	int lineStart = 1;
+	int ok = 1;
+	while (ok && gzgets(trace, line, REPLAY_LINE_SIZE) != NULL) {
+		size_t len = strlen(line);
+		int wholeLine = lineStart;
+		lineStart = len && line[len - 1] == '\n';
+		if (wholeLine && log.count == 0 && pendingLen == 0 && !(line[0] >= '0' && line[0] <= '9')) {
+			// A header line goes first, and names the time stamp column
+			char* header = strdup(line);
+			if (!header) _exit(1); // Exit if the memory allocation fails
+			int column = headerTimeColumn(header);
+			free(header);
+			if (column >= 0) timeColumn = column;
+		} else if (wholeLine) {
+			double traceTime = lineTime(line, timeColumn);
+			if (log.count == 0) firstTime = traceTime;
+			logPacket(&log, traceTime);
+			if (speed > 0) {
+				int64_t due = start + (int64_t) ((log.traceTime[log.count - 1] - firstTime) / speed * 1e9);
+				int64_t now = nowNs();
+				if (due > now) {
+					// Nothing more is due yet: send what is, then wait for this packet
+					if (pendingLen) {
+						ok = writeLines(out, pending, pendingLen, &log, pendingFirst, log.count - 1);
+						pendingLen = 0;
+					}
+					struct timespec ts = {due / 1000000000LL, due % 1000000000LL};
+					while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+					now = due;
+				}
+				if (now - due > maxLag) maxLag = now - due;
+				if (now - due > windowLag) windowLag = now - due;
+				if (!behindAt && now - due > (int64_t) (lagLimit * 1e9)) {
+					behindAt = log.count;
+					behindNs = now;
+				}
+				double scheduled = (log.traceTime[log.count - 1] - firstTime) / speed;
+				if (scheduled >= windowStart + REPLAY_WINDOW) {
+					if (windowLag <= (int64_t) (lagLimit * 1e9) && windowCt > bestWindowCt) bestWindowCt = windowCt;
+					windowStart += REPLAY_WINDOW * (double) (long) ((scheduled - windowStart) / REPLAY_WINDOW);
+					windowCt = 0;
+					windowLag = 0;
+				}
+				windowCt++;
+			}
+			if (pendingLen == 0) pendingFirst = log.count - 1;
+		}
+		memcpy(pending + pendingLen, line, len);
+		pendingLen += len;
+		if (pendingLen >= REPLAY_WRITE_SIZE) {
+			ok = writeLines(out, pending, pendingLen, &log, pendingFirst, log.count);
+			pendingLen = 0;
+		}
+	}
+	if (ok && pendingLen)
+		writeLines(out, pending, pendingLen, &log, pendingFirst, log.count);
+	int64_t end = nowNs();
+	double elapsed = (end - start) / 1e9;
+	gzclose(trace);
+	close(out);
+	int status;
+	waitpid(pid, &status, 0);
+	double analysed = (nowNs() - start) / 1e9;
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		printf("Warning: the analyser exited abnormally (its terminal output is discarded, so run it alone to see why)!\n");
+
+	printf("Replayed %lu packets of %s in %.3f s (%.0f packets/s), analysed in %.3f s\n", log.count, traceFile, elapsed,
+			elapsed > 0 ? log.count / elapsed : 0, analysed);
+	if (speed > 0) {
+		double traceLength = log.count ? log.traceTime[log.count - 1] - firstTime : 0;
+		printf("Paced at %gx the trace's %.3f s (%.0f packets/s offered on average)\n", speed, traceLength,
+				traceLength > 0 ? log.count * speed / traceLength : 0);
+		printf("Largest lag behind schedule: %.3f ms\n", maxLag / 1e6);
+		// (The last window is not a whole one, so its rate is not counted)
+		// Once behind, the pipe stays full and the analyser takes packets as fast as it can
+		if (behindAt)
+			printf("Fell behind (more than %.3f s) at packet %lu; from then on the analyser kept to %.0f packets/s, its highest "
+					"sustainable rate\n", lagLimit, behindAt, end > behindNs ? (log.count - behindAt) / ((end - behindNs) / 1e9) : 0);
+		else
+			printf("Kept up throughout; the highest rate over %g s was %.0f packets/s (not the limit: raise -speed)\n",
+					REPLAY_WINDOW, bestWindowCt / REPLAY_WINDOW);
+	} else {
+		printf("Unpaced, so the analyser's throughput of %.0f packets/s is its highest sustainable rate\n",
+				analysed > 0 ? log.count / analysed : 0);
+	}
+	detectionLatency(eventsFile, &log);
+	unlink(eventsFile);
+	free(line);
+	free(pending);
+	free(log.traceTime);
+	free(log.writeNs);
+	return 0;
+}
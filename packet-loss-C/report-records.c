@@ -0,0 +1,64 @@
+/** Structured report records in CSV or JSON Lines. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "PacketLoss.h"
+#include "out-buffer.h"
+#include "report-records.h"
+
+// Fields of a connection ID for the "%u.%u", "%u" formats below (see makeID())
+#define SRC_IP(id) (unsigned int) ((id) >> 56), (unsigned int) ((id) >> 48) % 0x100
+#define SRC_PORT(id) (unsigned int) ((id) >> 32) % 0x10000
+#define DST_IP(id) (unsigned int) ((id) >> 24) % 0x100, (unsigned int) ((id) >> 16) % 0x100
+#define DST_PORT(id) (unsigned int) (id) % 0x10000
+
+void emit_header(struct outBuffer* b, enum format format) {
+	if (format == FORMAT_CSV)
+		outbuf_printf(b, "record,src_ip,src_port,dst_ip,dst_port,seq_num,end_seq_num,bytes,time,"
+				"packets,trace_bytes,connections,open_connections\n");
+}
+
+void emit_open(struct outBuffer* b, enum format format, uint64_t connID, unsigned long seqNum, double timeStamp) {
+	if (format == FORMAT_CSV)
+		outbuf_printf(b, "open,192.168.%u.%u,%u,10.0.%u.%u,%u,%lu,,,%.6f,,,,\n",
+				SRC_IP(connID), SRC_PORT(connID), DST_IP(connID), DST_PORT(connID), seqNum, timeStamp);
+	else
+		outbuf_printf(b, "{\"record\": \"open\", \"src_ip\": \"192.168.%u.%u\", \"src_port\": %u, \"dst_ip\": \"10.0.%u.%u\", "
+				"\"dst_port\": %u, \"seq_num\": %lu, \"time\": %.6f}\n",
+				SRC_IP(connID), SRC_PORT(connID), DST_IP(connID), DST_PORT(connID), seqNum, timeStamp);
+}
+
+void emit_gap(struct outBuffer* b, enum format format, uint64_t connID, unsigned long fromSeqNum, unsigned long toSeqNum,
+		double timeStamp) {
+	if (format == FORMAT_CSV)
+		outbuf_printf(b, "gap,192.168.%u.%u,%u,10.0.%u.%u,%u,%lu,%lu,%ld,%.6f,,,,\n",
+				SRC_IP(connID), SRC_PORT(connID), DST_IP(connID), DST_PORT(connID),
+				fromSeqNum, toSeqNum, (long) (toSeqNum - fromSeqNum), timeStamp);
+	else
+		outbuf_printf(b, "{\"record\": \"gap\", \"src_ip\": \"192.168.%u.%u\", \"src_port\": %u, \"dst_ip\": \"10.0.%u.%u\", "
+				"\"dst_port\": %u, \"seq_num\": %lu, \"end_seq_num\": %lu, \"bytes\": %ld, \"time\": %.6f}\n",
+				SRC_IP(connID), SRC_PORT(connID), DST_IP(connID), DST_PORT(connID),
+				fromSeqNum, toSeqNum, (long) (toSeqNum - fromSeqNum), timeStamp);
+}
+
+void emit_warning(struct outBuffer* b, enum format format, uint64_t connID, unsigned long bytesMissing, double timeStamp) {
+	if (format == FORMAT_CSV)
+		outbuf_printf(b, "warning,192.168.%u.%u,%u,10.0.%u.%u,%u,,,%lu,%.6f,,,,\n",
+				SRC_IP(connID), SRC_PORT(connID), DST_IP(connID), DST_PORT(connID), bytesMissing, timeStamp);
+	else
+		outbuf_printf(b, "{\"record\": \"warning\", \"src_ip\": \"192.168.%u.%u\", \"src_port\": %u, \"dst_ip\": \"10.0.%u.%u\", "
+				"\"dst_port\": %u, \"bytes\": %lu, \"time\": %.6f}\n",
+				SRC_IP(connID), SRC_PORT(connID), DST_IP(connID), DST_PORT(connID), bytesMissing, timeStamp);
+}
+
+void emit_summary(struct outBuffer* b, enum format format, const struct traceTotals* totals) {
+	if (format == FORMAT_CSV)
+		outbuf_printf(b, "summary,,,,,,,%lu,%.6f,%lu,%lu,%d,%d\n", totals->missingBytes, totals->lastTimeStamp,
+				totals->packetCt, totals->byteCt, totals->connCt, totals->openConnCt);
+	else
+		outbuf_printf(b, "{\"record\": \"summary\", \"bytes\": %lu, \"time\": %.6f, \"packets\": %lu, \"trace_bytes\": %lu, "
+				"\"connections\": %d, \"open_connections\": %d}\n", totals->missingBytes, totals->lastTimeStamp,
+				totals->packetCt, totals->byteCt, totals->connCt, totals->openConnCt);
+}
@@ -0,0 +1,20 @@
+/**
+ * Structured reports (-format csv or jsonl): one record per line for each open connection, gap, warning and the
+ * trace totals, for dashboards to load without parsing the text report. Each record is formatted once, into an
+ * output buffer which is written to the report file in one large write; records are not printed to the terminal.
+ *
+ * CSV records share one header line; fields which do not apply to a record are left empty:
+ *   record,src_ip,src_port,dst_ip,dst_port,seq_num,end_seq_num,bytes,time,packets,trace_bytes,connections,open_connections
+ * - open: connection expecting seq_num since time
+ * - gap: bytes missing between seq_num and end_seq_num, noticed at time
+ * - warning: open connection (bytes 0) or gap older than the last 20 s of the trace, since time
+ * - summary: bytes missing from the whole trace, last time stamp and trace totals
+ * JSON Lines records have the same fields, leaving out those which do not apply.
+ */
+
+void emit_header(struct outBuffer* b, enum format format);
+void emit_open(struct outBuffer* b, enum format format, uint64_t connID, unsigned long seqNum, double timeStamp);
+void emit_gap(struct outBuffer* b, enum format format, uint64_t connID, unsigned long fromSeqNum, unsigned long toSeqNum,
+		double timeStamp);
+void emit_warning(struct outBuffer* b, enum format format, uint64_t connID, unsigned long bytesMissing, double timeStamp);
+void emit_summary(struct outBuffer* b, enum format format, const struct traceTotals* totals);
@@ -0,0 +1,177 @@
+/** Trace column layouts and the line decoders specialized for them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "PacketLoss.h"
+#include "schema.h"
+
+// Columns of the fields (in enum field order) in the standard tshark profiles
+#define FULL_COLUMNS {1, 2, 3, 4, 5, 8, 9, 11, 13}
+#define COMPACT_COLUMNS {0, 1, 2, 3, 4, 5, 6, 7, 8}
+
+/**
+ * Names of the tshark fields which the analysis reads.
+ */
+static const struct {
+	const char* name;
+	enum field field;
+} fieldNames[] = {
+	{"frame.time_relative", FIELD_TIME},
+	{"frame.time_epoch", FIELD_TIME},
+	{"ip.src", FIELD_SRC_IP},
+	{"tcp.srcport", FIELD_SRC_PORT},
+	{"ip.dst", FIELD_DST_IP},
+	{"tcp.dstport", FIELD_DST_PORT},
+	{"tcp.len", FIELD_PAYLOAD},
+	{"tcp.flags.syn", FIELD_SYN},
+	{"tcp.flags.fin", FIELD_FIN},
+	{"tcp.seq", FIELD_SEQ},
+	{"tcp.seq_relative", FIELD_SEQ}
+};
+
+/**
+ * Function for decoding the fields of a trace line, once it has passed the filter. Fields past the end of a short
+ * line keep their values from the previous line. Always inlined, so that the decoder of a known profile is compiled
+ * with its columns as constants.
+ */
+static inline __attribute__((always_inline)) int decodeColumns(const int* column, char fields[][FIELD_SIZE], int lastColumn,
+		struct packet* currPacket, struct connection* currConnection, unsigned long* byteCt) {
+	int dataComplete = 1;
+#define HAS_FIELD(f) (column[f] >= 0 && column[f] <= lastColumn)
+	if (HAS_FIELD(FIELD_TIME))
+		currPacket->timeStamp = atof(fields[column[FIELD_TIME]]);
+	if (HAS_FIELD(FIELD_SRC_IP)) {
+		if (fields[column[FIELD_SRC_IP]][0] == 0)
+			dataComplete = 0;
+		currConnection->sourceIP = parseIP(fields[column[FIELD_SRC_IP]]);
+	}
+	if (HAS_FIELD(FIELD_SRC_PORT)) {
+		if (fields[column[FIELD_SRC_PORT]][0] == 0)
+			dataComplete = 0;
+		currConnection->sourcePort = atol(fields[column[FIELD_SRC_PORT]]);
+	}
+	if (HAS_FIELD(FIELD_DST_IP)) {
+		if (fields[column[FIELD_DST_IP]][0] == 0)
+			dataComplete = 0;
+		currConnection->destIP = parseIP(fields[column[FIELD_DST_IP]]);
+	}
+	if (HAS_FIELD(FIELD_DST_PORT)) {
+		if (fields[column[FIELD_DST_PORT]][0] == 0)
+			dataComplete = 0;
+		currConnection->destPort = atol(fields[column[FIELD_DST_PORT]]);
+		currPacket->connID = makeID(*currConnection);
+	}
+	if (HAS_FIELD(FIELD_PAYLOAD)) {
+		currPacket->payloadSize = atoi(fields[column[FIELD_PAYLOAD]]);
+		*byteCt += currPacket->payloadSize;
+	}
+	if (HAS_FIELD(FIELD_SYN))
+		currPacket->syn = atoi(fields[column[FIELD_SYN]]);
+	if (HAS_FIELD(FIELD_FIN))
+		currPacket->fin = atoi(fields[column[FIELD_FIN]]);
+	if (HAS_FIELD(FIELD_SEQ))
+		currPacket->seqNum = atoi(fields[column[FIELD_SEQ]]);
+#undef HAS_FIELD
+	return dataComplete;
+}
+
+static int decodeFull(const struct schema* s, char fields[][FIELD_SIZE], int lastColumn, struct packet* currPacket,
+		struct connection* currConnection, unsigned long* byteCt) {
+	static const int column[FIELD_COUNT] = FULL_COLUMNS;
+	(void) s;
+	return decodeColumns(column, fields, lastColumn, currPacket, currConnection, byteCt);
+}
+
+static int decodeCompact(const struct schema* s, char fields[][FIELD_SIZE], int lastColumn, struct packet* currPacket,
+		struct connection* currConnection, unsigned long* byteCt) {
+	static const int column[FIELD_COUNT] = COMPACT_COLUMNS;
+	(void) s;
+	return decodeColumns(column, fields, lastColumn, currPacket, currConnection, byteCt);
+}
+
+// Decoder for any other layout, reading the columns from the schema
+static int decodeGeneric(const struct schema* s, char fields[][FIELD_SIZE], int lastColumn, struct packet* currPacket,
+		struct connection* currConnection, unsigned long* byteCt) {
+	return decodeColumns(s->column, fields, lastColumn, currPacket, currConnection, byteCt);
+}
+
+/**
+ * Full tshark profile: frame, time, src IP, src port, dst IP, dst port, frame len, IP len, TCP payload, SYN, ACK,
+ * FIN, RST, seq num, ack num (the layout gen-trace.awk writes and the Java analyzer reads).
+ */
+const struct schema schemaFull = {"full tshark profile", FULL_COLUMNS,
+		1u << 1 | 1u << 2 | 1u << 3 | 1u << 4 | 1u << 5 | 1u << 8 | 1u << 9 | 1u << 11 | 1u << 13, decodeFull};
+
+/**
+ * Compact tshark profile with only the fields the analysis reads: time, src IP, src port, dst IP, dst port,
+ * TCP payload, SYN, FIN, seq num.
+ */
+const struct schema schemaCompact = {"compact tshark profile", COMPACT_COLUMNS, 0x1ff, decodeCompact};
+
+/**
+ * Function for building a schema from the column names of a header line, split at any of the separators. Layouts
+ * which match a known profile get its specialized decoder. Returns 0 (after printing the problem) if the layout
+ * lacks a field the analysis needs.
+ */
+int schema_parse(struct schema* s, char* names, const char* separators) {
+	static const char* fieldLabels[FIELD_COUNT] = {
+		"time", "source IP", "source port", "destination IP", "destination port", "TCP payload", "SYN", "FIN", "sequence number"
+	};
+	*s = (struct schema){"generic layout", {0}, 0, decodeGeneric};
+	for (int f = 0; f < FIELD_COUNT; f++) s->column[f] = -1;
+
+	// Split by hand rather than with strtok(), since tab separated headers can have empty names
+	int col = 0;
+	for (char* name = names; name != NULL && col < MAX_COLUMNS; col++) {
+		char* next = name + strcspn(name, separators);
+		next = *next ? (*next = 0, next + 1) : NULL;
+		for (unsigned int i = 0; i < sizeof fieldNames / sizeof fieldNames[0]; i++) {
+			if (strcmp(name, fieldNames[i].name) == 0 && s->column[fieldNames[i].field] < 0) {
+				s->column[fieldNames[i].field] = col;
+				s->used |= 1u << col;
+			}
+		}
+		name = next;
+	}
+
+	for (int f = 0; f < FIELD_COUNT; f++) {
+		if (s->column[f] < 0 && f != FIELD_SYN && f != FIELD_FIN) {
+			printf("Error: trace layout has no %s column!\n", fieldLabels[f]);
+			return 0;
+		}
+	}
+
+	const struct schema* known[] = {&schemaFull, &schemaCompact};
+	for (unsigned int i = 0; i < sizeof known / sizeof known[0]; i++) {
+		if (memcmp(s->column, known[i]->column, sizeof s->column) == 0) {
+			*s = *known[i];
+			break;
+		}
+	}
+	return 1;
+}
+
+/**
+ * Function for building a schema from a file naming the trace columns in order, separated by tabs, commas or
+ * line breaks.
+ */
+int schema_load(struct schema* s, const char* filename) {
+	FILE* file = fopen(filename, "r");
+	if (file == NULL) {
+		perror("Error opening columns file");
+		return 0;
+	}
+	char names[4096] = {0};
+	size_t len = fread(names, 1, sizeof names - 1, file);
+	fclose(file);
+	// Drop carriage returns and trailing line breaks, which would otherwise count as empty columns
+	size_t kept = 0;
+	for (size_t i = 0; i < len; i++)
+		if (names[i] != '\r') names[kept++] = names[i];
+	while (kept && names[kept - 1] == '\n') kept--;
+	names[kept] = 0;
+	return schema_parse(s, names, "\t,\n");
+}
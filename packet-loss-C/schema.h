@@ -0,0 +1,23 @@
+/**
+ * Column layout of a trace: which tab separated column holds each field the analysis reads. The layout is read from
+ * a header line at the top of the trace (tshark -T fields -E header=y), or from a file naming the columns for traces
+ * without one; otherwise it is the full tshark profile. The known profiles have line decoders specialized for their
+ * columns at compile time, and any other layout is decoded through its column table.
+ */
+
+struct schema;
+typedef int (*lineDecoder)(const struct schema* s, char fields[][FIELD_SIZE], int lastColumn, struct packet* currPacket,
+		struct connection* currConnection, unsigned long* byteCt);
+
+struct schema {
+	const char* name;
+	int column[FIELD_COUNT]; // Column of each field, -1 if the trace does not have it
+	uint32_t used; // Bit set of the columns holding fields (only these are kept while a line is read)
+	lineDecoder decode; // Returns 0 if a connection field of the line is empty
+};
+
+extern const struct schema schemaFull;
+extern const struct schema schemaCompact;
+
+int schema_parse(struct schema* s, char* names, const char* separators);
+int schema_load(struct schema* s, const char* filename);
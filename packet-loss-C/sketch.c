@@ -0,0 +1,241 @@
+/** Approximate packet loss analysis in bounded memory, using a flow cache, Space-Saving and HyperLogLog. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "PacketLoss.h"
+#include "sketch.h"
+
+// 64-bit mixing function (splitmix64 finalizer), so that nearby connection IDs spread over the sets and registers
+static uint64_t sketch_hash(uint64_t key) {
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	return key;
+}
+
+struct sketch* sketch_new() {
+	struct sketch* sk = calloc(1, sizeof(struct sketch));
+	sk->flows = calloc((size_t) SKETCH_FLOW_SETS * SKETCH_FLOW_WAYS, sizeof(struct flowSlot));
+	sk->forgotten = calloc(SKETCH_BLOOM_BITS / 8, 1);
+	if (!sk->flows || !sk->forgotten) _exit(1); // Exit if the memory allocation fails
+	return sk;
+}
+
+void sketch_del(struct sketch* sk) {
+	free(sk->flows);
+	free(sk->forgotten);
+	free(sk);
+}
+
+/* Bloom filter of forgotten flows (k = 3, bit positions taken from the 64-bit hash) */
+static void bloom_add(struct sketch* sk, uint64_t hash) {
+	for (int k = 0; k < 3; k++) {
+		uint32_t bit = (uint32_t) (hash >> (k * 21)) & (SKETCH_BLOOM_BITS - 1);
+		sk->forgotten[bit >> 3] |= (uint8_t) (1 << (bit & 7));
+	}
+}
+
+static int bloom_test(struct sketch* sk, uint64_t hash) {
+	for (int k = 0; k < 3; k++) {
+		uint32_t bit = (uint32_t) (hash >> (k * 21)) & (SKETCH_BLOOM_BITS - 1);
+		if (!(sk->forgotten[bit >> 3] & (1 << (bit & 7)))) return 0;
+	}
+	return 1;
+}
+
+/* HyperLogLog */
+static void hll_add(struct sketch* sk, uint64_t hash) {
+	unsigned int index = (unsigned int) (hash >> (64 - HLL_PRECISION));
+	uint8_t rank = (uint8_t) __builtin_clzll((hash << HLL_PRECISION) | (1ULL << (HLL_PRECISION - 1))) + 1;
+	if (rank > sk->hll[index]) sk->hll[index] = rank;
+}
+
+/**
+ * Function for estimating the number of distinct connections seen so far.
+ */
+double sketch_distinct_conns(struct sketch* sk) {
+	const double m = HLL_REGISTERS;
+	double sum = 0;
+	int zeros = 0;
+	for (int i = 0; i < HLL_REGISTERS; i++) {
+		sum += ldexp(1.0, -sk->hll[i]);
+		if (sk->hll[i] == 0) zeros++;
+	}
+	double estimate = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+	if (estimate <= 2.5 * m && zeros) estimate = m * log(m / zeros); // Linear counting for small cardinalities
+	return estimate;
+}
+
+/* Space-Saving */
+static void topk_add(struct sketch* sk, uint64_t connID, unsigned long bytesMissing, double timeStamp) {
+	unsigned int min = 0;
+	for (unsigned int i = 0; i < sk->topKCount; i++) {
+		if (sk->topK[i].connID == connID) {
+			sk->topK[i].bytesMissing += bytesMissing;
+			return;
+		}
+		if (sk->topK[i].bytesMissing < sk->topK[min].bytesMissing) min = i;
+	}
+	if (sk->topKCount < SKETCH_TOP_K) {
+		sk->topK[sk->topKCount++] = (struct ssCounter) {connID, bytesMissing, 0, timeStamp};
+	} else {
+		// Replace the smallest counter, which bounds the error of the new entry
+		sk->topK[min] = (struct ssCounter) {connID, sk->topK[min].bytesMissing + bytesMissing, sk->topK[min].bytesMissing, timeStamp};
+	}
+}
+
+/**
+ * Function for recording the missing bytes of a flow which is leaving the flow cache.
+ */
+static void flushFlow(struct sketch* sk, struct flowSlot* slot) {
+	if (slot->bytesMissing) {
+		sk->totalMissing += slot->bytesMissing;
+		topk_add(sk, slot->connID, slot->bytesMissing, slot->missingSince);
+	}
+	bloom_add(sk, sketch_hash(slot->connID));
+	memset(slot, 0, sizeof(struct flowSlot));
+}
+
+/**
+ * Function for updating the sketch with a packet. Gaps in the sequence numbers of a flow are counted as missing
+ * bytes; a late packet below the next expected sequence number is assumed to fill in part of an earlier gap.
+ */
+void sketch_update(struct sketch* sk, struct packet currPacket) {
+	uint64_t hash = sketch_hash(currPacket.connID);
+	hll_add(sk, hash);
+
+	// Find the flow in its set, or the least recently used slot to replace
+	struct flowSlot* set = &sk->flows[(hash & (SKETCH_FLOW_SETS - 1)) * SKETCH_FLOW_WAYS];
+	struct flowSlot* slot = NULL;
+	struct flowSlot* victim = &set[0];
+	for (int w = 0; w < SKETCH_FLOW_WAYS; w++) {
+		if (set[w].connID == currPacket.connID) {
+			slot = &set[w];
+			break;
+		}
+		if (victim->connID != 0 && (set[w].connID == 0 || set[w].timeStamp < victim->timeStamp)) victim = &set[w];
+	}
+	if (slot == NULL) {
+		// A flow which was evicted or closed earlier resumes where it is, instead of counting a gap from its start.
+		// Bare ACKs after it was closed do not reopen it.
+		int resumed = currPacket.seqNum > 1 && bloom_test(sk, hash);
+		if (resumed && currPacket.payloadSize == 0 && !currPacket.fin) return;
+		if (victim->connID != 0) {
+			flushFlow(sk, victim);
+			sk->evictionCt++;
+		}
+		slot = victim;
+		slot->connID = currPacket.connID;
+		slot->seqNum = resumed ? currPacket.seqNum : 1;
+	}
+	slot->timeStamp = currPacket.timeStamp;
+
+	if (currPacket.seqNum >= slot->seqNum) {
+		if (currPacket.seqNum > slot->seqNum) {
+			if (slot->bytesMissing == 0) slot->missingSince = currPacket.timeStamp;
+			slot->bytesMissing += currPacket.seqNum - slot->seqNum;
+		}
+		slot->seqNum = currPacket.seqNum + currPacket.payloadSize + currPacket.fin;
+		slot->finSeen |= currPacket.fin;
+	} else if (slot->bytesMissing) {
+		slot->bytesMissing -= (currPacket.payloadSize < slot->bytesMissing) ? currPacket.payloadSize : slot->bytesMissing;
+	}
+
+	// Connection closed with every byte accounted for
+	if (slot->finSeen && slot->bytesMissing == 0) {
+		flushFlow(sk, slot);
+		sk->closedCt++;
+	}
+}
+
+static int cmpCounters(const void* a, const void* b) {
+	const struct ssCounter* x = a;
+	const struct ssCounter* y = b;
+	return (x->bytesMissing < y->bytesMissing) - (x->bytesMissing > y->bytesMissing);
+}
+
+/**
+ * Function for outputting the summary statistics of the approximate analysis.
+ */
+void sketch_summary(struct sketch* sk, unsigned int topK, unsigned long packetCt, unsigned long byteCt, double lastTimeStamp,
+		const char* outputFilename, struct traceTotals* totals) {
+	FILE *file;
+	file = fopen(outputFilename, "w");
+	if(file == NULL) {
+		perror("Error opening output file");
+		return;
+	}
+
+	puts("\nParse finished! Analysing trace statistics (sketch mode)...");
+	fputs("======================================================================================\n", file);
+	fprintf(file, "* OUTPUT FROM APPROXIMATE PACKET LOSS ANALYSIS of %s\n", outputFilename);
+	fputs("======================================================================================\n\n", file);
+
+	// Flows still in the cache are open connections; flush their missing bytes into the totals
+	unsigned long openConnCt = 0;
+	for (unsigned long i = 0; i < (unsigned long) SKETCH_FLOW_SETS * SKETCH_FLOW_WAYS; i++) {
+		if (sk->flows[i].connID == 0) continue;
+		flushFlow(sk, &sk->flows[i]);
+		openConnCt++;
+	}
+
+	char ipString[48];
+	int warningCt = 0;
+	qsort(sk->topK, sk->topKCount, sizeof(struct ssCounter), cmpCounters);
+	puts("\nLossiest connections (estimated):");
+	fputs("\nLossiest connections (estimated):\n", file);
+	for (unsigned int i = 0; i < sk->topKCount; i++) {
+		if (topK && i >= topK) break;
+		IDToString(ipString, sk->topK[i].connID);
+		printf("%s missing %lu bytes (+/- %lu) since %.3f\n",
+				ipString, sk->topK[i].bytesMissing, sk->topK[i].error, sk->topK[i].timeStamp);
+		fprintf(file, "%s missing %lu bytes (+/- %lu) since %.3f\n",
+				ipString, sk->topK[i].bytesMissing, sk->topK[i].error, sk->topK[i].timeStamp);
+		if (sk->topK[i].timeStamp < lastTimeStamp - 20) warningCt++;
+	}
+	if (sk->topKCount == 0) {
+		puts("None.");
+		fputs("None.\n", file);
+	}
+
+	unsigned long memory = sizeof(struct sketch) + (unsigned long) SKETCH_FLOW_SETS * SKETCH_FLOW_WAYS * sizeof(struct flowSlot)
+			+ SKETCH_BLOOM_BITS / 8;
+	double connCt = sketch_distinct_conns(sk);
+
+	puts("\n\nSummary:");
+	printf("%lu packets checked containing a total of %lu bytes from ~%.0f connections.\n\n", packetCt, byteCt, connCt);
+	printf("~%lu / %lu bytes missing from trace sequence (%.3f%% loss).\n\n", sk->totalMissing, byteCt, sk->totalMissing / (double) byteCt);
+	printf("%lu connection(s) closed, %lu still open, %lu evicted from the flow cache.\n\n", sk->closedCt, openConnCt, sk->evictionCt);
+	printf("Sketch memory: %lu bytes.\n\n\n", memory);
+
+	fputs("======================================================================================\n", file);
+	fputs("\n\nSummary:\n", file);
+	fprintf(file, "%lu packets checked containing a total of %lu bytes from ~%.0f connections.\n\n", packetCt, byteCt, connCt);
+	fprintf(file, "~%lu / %lu bytes missing from trace sequence (%.3f%% loss).\n\n", sk->totalMissing, byteCt, sk->totalMissing / (double) byteCt);
+	fprintf(file, "%lu connection(s) closed, %lu still open, %lu evicted from the flow cache.\n\n", sk->closedCt, openConnCt, sk->evictionCt);
+	fprintf(file, "Sketch memory: %lu bytes.\n\n\n", memory);
+	*totals = (struct traceTotals){1, packetCt, byteCt, (int) (connCt + 0.5), (int) openConnCt, sk->totalMissing, lastTimeStamp};
+
+	puts("======================================================================================");
+	fputs("======================================================================================\n", file);
+	if (warningCt) {
+		printf("* Warning! %d of the lossiest connections have had packets missing since before last 20 s of trace!\n", warningCt);
+		fprintf(file, "* Warning! %d of the lossiest connections have had packets missing since before last 20 s of trace!\n", warningCt);
+	} else {
+		puts("* No packets missing before last 20 s of trace among the lossiest connections.");
+		fputs("* No packets missing before last 20 s of trace among the lossiest connections.\n", file);
+	}
+	puts("======================================================================================");
+	puts("\n");
+	fputs("======================================================================================\n", file);
+	fputs("\n", file);
+
+	fclose(file);
+}
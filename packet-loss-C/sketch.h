@@ -0,0 +1,47 @@
+/**
+ * Approximate ("sketch") analysis engine with a fixed memory footprint, for traces with too many
+ * flows to track exactly in connHT. Flow state is kept in a set-associative flow cache, per-flow
+ * missing bytes are ranked with a Space-Saving heavy hitter table and the distinct connection count
+ * is estimated with HyperLogLog.
+ */
+
+#define SKETCH_FLOW_SETS (1 << 16) // Sets in the flow cache (must be a power of 2)
+#define SKETCH_FLOW_WAYS 4 // Flows per set
+#define SKETCH_BLOOM_BITS (1 << 23) // Bits in the filter of flows evicted or closed
+#define SKETCH_TOP_K 100 // Counters in the Space-Saving table
+#define HLL_PRECISION 14
+#define HLL_REGISTERS (1 << HLL_PRECISION)
+
+struct flowSlot {
+	uint64_t connID; // 0 if the slot is free
+	unsigned long seqNum; // Next expected sequence number
+	unsigned long bytesMissing; // Bytes skipped over and not yet filled in by a late packet
+	double timeStamp; // Time stamp of the last packet of the flow
+	double missingSince; // Time stamp of the packet that opened the first outstanding gap
+	int finSeen;
+};
+
+struct ssCounter {
+	uint64_t connID;
+	unsigned long bytesMissing; // Estimated count (an over-estimate by at most error)
+	unsigned long error;
+	double timeStamp;
+};
+
+struct sketch {
+	struct flowSlot* flows;
+	uint8_t* forgotten; // Bloom filter of flows which have been evicted from the flow cache or closed
+	struct ssCounter topK[SKETCH_TOP_K];
+	unsigned int topKCount;
+	uint8_t hll[HLL_REGISTERS];
+	unsigned long totalMissing;
+	unsigned long closedCt;
+	unsigned long evictionCt;
+};
+
+struct sketch* sketch_new();
+void sketch_update(struct sketch* sk, struct packet currPacket);
+double sketch_distinct_conns(struct sketch* sk);
+void sketch_summary(struct sketch* sk, unsigned int topK, unsigned long packetCt, unsigned long byteCt, double lastTimeStamp,
+		const char* outputFilename, struct traceTotals* totals);
+void sketch_del(struct sketch* sk);
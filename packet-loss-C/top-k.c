@@ -0,0 +1,115 @@
+/** Bounded min-heap of connection reports, keeping the K lossiest connections seen so far. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "PacketLoss.h"
+#include "top-k.h"
+
+// Returns whether connection a ranks as lossier than connection b
+static int lossier(const struct connReport* a, const struct connReport* b, enum rank rank) {
+	switch (rank) {
+		case RANK_GAPS :
+			if (a->gapCt != b->gapCt) return a->gapCt > b->gapCt;
+			break;
+		case RANK_AGE :
+			if (a->timeStamp != b->timeStamp) return a->timeStamp < b->timeStamp;
+			break;
+		case RANK_BYTES :
+			break;
+	}
+	if (a->bytesMissing != b->bytesMissing) return a->bytesMissing > b->bytesMissing;
+	return a->connID < b->connID; // Keep the order deterministic on ties
+}
+
+const char* rankName(enum rank rank) {
+	switch (rank) {
+		case RANK_GAPS : return "gap count";
+		case RANK_AGE : return "age";
+		default : return "missing bytes";
+	}
+}
+
+void topconns_init(struct topConns* t, unsigned int k, enum rank rank) {
+	*t = (struct topConns){
+		.k = k,
+		.count = 0,
+		.rank = rank,
+		.data = malloc(sizeof(struct connReport) * k)
+	};
+	if (!t->data) _exit(1); // Exit if the memory allocation fails
+}
+
+// Appends a gap to the gap list of a connection report
+void report_add_gap(struct connReport* report, unsigned long fromSeqNum, unsigned long toSeqNum, double timeStamp) {
+	if (report->gapCt == report->gapSize) {
+		report->gapSize = report->gapSize ? report->gapSize << 1 : 4;
+		report->gaps = realloc(report->gaps, sizeof(struct gap) * report->gapSize);
+		if (!report->gaps) _exit(1); // Exit if the memory allocation fails
+	}
+	report->gaps[report->gapCt++] = (struct gap){fromSeqNum, toSeqNum, timeStamp};
+	report->bytesMissing += toSeqNum - fromSeqNum;
+}
+
+// Moves the element at index down to the right position in the heap
+static void sift_down(struct topConns* t, unsigned int index) {
+	unsigned int swap, other;
+	struct connReport temp = t->data[index];
+	for(; 1; index = swap)
+	{
+		swap = (index << 1) + 1;
+		if (swap >= t->count) break;
+		other = swap + 1;
+		if ((other < t->count) && lossier(&t->data[swap], &t->data[other], t->rank)) swap = other;
+		if (lossier(&t->data[swap], &temp, t->rank)) break;
+		t->data[index] = t->data[swap];
+	}
+	t->data[index] = temp;
+}
+
+/**
+ * Function for offering a connection report to the top K. The heap takes over the gap list of the report,
+ * and frees it if the connection does not make it (or is later pushed out).
+ */
+void topconns_offer(struct topConns* t, struct connReport* report) {
+	unsigned int index, parent;
+	if (t->count < t->k) {
+		for(index = t->count++; index; index = parent)
+		{
+			parent = (index - 1) >> 1;
+			if (lossier(report, &t->data[parent], t->rank)) break;
+			t->data[index] = t->data[parent];
+		}
+		t->data[index] = *report;
+	} else if (t->k && lossier(report, &t->data[0], t->rank)) {
+		free(t->data[0].gaps);
+		t->data[0] = *report;
+		sift_down(t, 0);
+	} else {
+		free(report->gaps);
+	}
+	report->gaps = NULL;
+}
+
+/**
+ * Function for sorting the kept connections from the lossiest down. The heap is consumed, leaving the
+ * sorted reports in t->data.
+ */
+void topconns_sort(struct topConns* t) {
+	unsigned int count = t->count;
+	// Heapsort: repeatedly move the least lossy element to the end
+	while (t->count > 1) {
+		struct connReport least = t->data[0];
+		t->data[0] = t->data[--t->count];
+		sift_down(t, 0);
+		t->data[t->count] = least;
+	}
+	t->count = count;
+}
+
+void topconns_term(struct topConns* t) {
+	for (unsigned int i = 0; i < t->count; i++) free(t->data[i].gaps);
+	free(t->data);
+}
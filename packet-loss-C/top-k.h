@@ -0,0 +1,38 @@
+/**
+ * Bounded heap of the lossiest connections, for reports which only give gap details for the top K. It is kept for the
+ * whole parse: a connection which closes with gaps left is offered to it by closeConn() (it is then deleted from the
+ * table by reapClosedConns() with nothing left to offer), and the summary merges the connections still open into it.
+ * A connection's missing bytes are only known once its out-of-sequence buffer is walked, so the open connections are
+ * still collated from one scan of the connection table at the end.
+ */
+
+struct gap {
+	unsigned long fromSeqNum;
+	unsigned long toSeqNum;
+	double timeStamp;
+};
+
+struct connReport {
+	uint64_t connID;
+	unsigned long seqNum; // Next expected sequence number
+	double timeStamp; // Time stamp of the last packet received in sequence
+	unsigned long bytesMissing;
+	unsigned int gapCt;
+	unsigned int gapSize; // Size of the allocated memory (in number of gaps)
+	struct gap* gaps;
+	int closed; // Whether the connection closed during the parse (timeStamp is then the time it closed)
+};
+
+struct topConns {
+	unsigned int k;
+	unsigned int count;
+	enum rank rank;
+	struct connReport* data; // Min-heap with the least lossy kept connection at the front
+};
+
+void topconns_init(struct topConns* t, unsigned int k, enum rank rank);
+void report_add_gap(struct connReport* report, unsigned long fromSeqNum, unsigned long toSeqNum, double timeStamp);
+void topconns_offer(struct topConns* t, struct connReport* report);
+void topconns_sort(struct topConns* t);
+void topconns_term(struct topConns* t);
+const char* rankName(enum rank rank);
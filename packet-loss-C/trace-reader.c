@@ -0,0 +1,358 @@
+/** Trace file reader, reading plain traces ahead of the parser and decompressing gzip traces on a separate thread. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "trace-reader.h"
+
+/**
+ * Function for reading the block at offset into a buffer. Continues after short reads, which network file systems
+ * can return before the end of the file. Returns the bytes read, less than a block only at the end of the trace.
+ */
+static size_t readBlock(int fd, char* data, off_t offset) {
+	size_t len = 0;
+	while (len < TRACE_BUFFER_SIZE) {
+		ssize_t n = pread(fd, data + len, TRACE_BUFFER_SIZE - len, offset + (off_t) len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0)
+			perror("Error reading trace"); // The trace then ends at the last byte which could be read
+		if (n <= 0)
+			break;
+		len += (size_t) n;
+	}
+	return len;
+}
+
+/**
+ * Function for a read thread. Takes the next block of the trace as soon as the buffer it goes into is free, so with
+ * several threads several reads are in flight, and hands the buffer to the parser once it is filled.
+ */
+static void* readBlocks(void* arg) {
+	struct traceReader* r = arg;
+	pthread_mutex_lock(&r->lock);
+	while (!r->stop && !r->eof) {
+		struct traceBuffer* b = &r->buffers[r->nextOffset / TRACE_BUFFER_SIZE % TRACE_BUFFERS];
+		if (b->state != BUFFER_FREE) {
+			pthread_cond_wait(&r->cond, &r->lock);
+			continue;
+		}
+		b->state = BUFFER_FILLING;
+		b->offset = r->nextOffset;
+		r->nextOffset += TRACE_BUFFER_SIZE;
+		pthread_mutex_unlock(&r->lock);
+
+		size_t len = readBlock(r->fd, b->data, b->offset);
+
+		pthread_mutex_lock(&r->lock);
+		b->len = len;
+		b->state = BUFFER_FULL;
+		if (len < TRACE_BUFFER_SIZE)
+			r->eof = 1;
+		pthread_cond_broadcast(&r->cond);
+	}
+	pthread_mutex_unlock(&r->lock);
+	return NULL;
+}
+
+/**
+ * Function for the decompression thread. Fills the buffers of the ring in turn, waiting for the parser to hand
+ * each one back, until the end of the trace (marked by a buffer which is not filled).
+ */
+static void* decompress(void* arg) {
+	struct traceReader* r = arg;
+	for (unsigned int i = 0; ; i = (i + 1) % TRACE_BUFFERS) {
+		struct traceBuffer* b = &r->buffers[i];
+		pthread_mutex_lock(&r->lock);
+		while (b->state != BUFFER_FREE && !r->stop)
+			pthread_cond_wait(&r->cond, &r->lock);
+		int stop = r->stop;
+		b->state = BUFFER_FILLING;
+		pthread_mutex_unlock(&r->lock);
+		if (stop) return NULL;
+
+		int len = gzread(r->gz, b->data, TRACE_BUFFER_SIZE);
+		if (len <= 0) {
+			// A corrupt or truncated trace ends at the last byte which could be decompressed
+			int err;
+			const char* msg = gzerror(r->gz, &err);
+			if (err != Z_OK) printf("Error decompressing trace: %s\n", msg);
+			len = 0;
+		}
+
+		pthread_mutex_lock(&r->lock);
+		b->len = (size_t) len;
+		b->state = BUFFER_FULL;
+		pthread_cond_broadcast(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+		if (len < TRACE_BUFFER_SIZE) return NULL;
+	}
+}
+
+#ifdef HAVE_LIBURING
+/**
+ * Function for queueing the read of the rest of a buffer's block.
+ */
+static void ringSubmit(struct traceReader* r, struct traceBuffer* b) {
+	struct io_uring_sqe* sqe = io_uring_get_sqe(r->ring);
+	io_uring_prep_read(sqe, r->fd, b->data + b->len, TRACE_BUFFER_SIZE - b->len, b->offset + (off_t) b->len);
+	io_uring_sqe_set_data(sqe, b);
+	io_uring_submit(r->ring);
+}
+
+/**
+ * Function for queueing the read of the next block of the trace into a free buffer.
+ */
+static void ringRead(struct traceReader* r, struct traceBuffer* b) {
+	b->state = BUFFER_FILLING;
+	b->offset = r->nextOffset;
+	b->len = 0;
+	r->nextOffset += TRACE_BUFFER_SIZE;
+	ringSubmit(r, b);
+}
+
+/**
+ * Function for waiting for the next read to complete. A short read before the end of the trace is queued again for
+ * the rest of its block.
+ */
+static void ringComplete(struct traceReader* r) {
+	struct io_uring_cqe* cqe;
+	int ret;
+	while ((ret = io_uring_wait_cqe(r->ring, &cqe)) == -EINTR);
+	if (ret < 0) {
+		errno = -ret;
+		perror("Error waiting for trace read");
+		_exit(1);
+	}
+	struct traceBuffer* b = io_uring_cqe_get_data(cqe);
+	int res = cqe->res;
+	io_uring_cqe_seen(r->ring, cqe);
+	if (res == -EINTR || res == -EAGAIN) {
+		ringSubmit(r, b);
+		return;
+	}
+	if (res < 0) {
+		errno = -res;
+		perror("Error reading trace"); // The trace then ends at the last byte which could be read
+	}
+	if (res > 0) {
+		b->len += (size_t) res;
+		if (b->len < TRACE_BUFFER_SIZE) {
+			ringSubmit(r, b);
+			return;
+		}
+	}
+	b->state = BUFFER_FULL;
+	if (b->len < TRACE_BUFFER_SIZE)
+		r->eof = 1;
+}
+
+/**
+ * Function for setting up io_uring for a plain trace and queueing a read into every buffer. Returns 0 if io_uring
+ * is not available (such as on older kernels), leaving the read threads to do the reading.
+ */
+static int ringStart(struct traceReader* r) {
+	r->ring = malloc(sizeof(struct io_uring));
+	if (!r->ring) _exit(1); // Exit if the memory allocation fails
+	if (io_uring_queue_init(TRACE_BUFFERS, r->ring, 0) < 0) {
+		free(r->ring);
+		r->ring = NULL;
+		return 0;
+	}
+	for (int i = 0; i < TRACE_BUFFERS; i++)
+		ringRead(r, &r->buffers[i]);
+	return 1;
+}
+
+/**
+ * Function for waiting out the reads still in flight and tearing down io_uring.
+ */
+static void ringStop(struct traceReader* r) {
+	for (int i = 0; i < TRACE_BUFFERS; i++)
+		while (r->buffers[i].state == BUFFER_FILLING)
+			ringComplete(r);
+	io_uring_queue_exit(r->ring);
+	free(r->ring);
+}
+#endif
+
+/**
+ * Function for opening a trace, or standard input if it is named -. Gzip-compressed traces are recognised by their
+ * magic number, whatever their name. Returns NULL if the trace cannot be opened.
+ */
+struct traceReader* trace_open(const char* filename) {
+	int live = strcmp(filename, "-") == 0;
+	int fd = live ? dup(STDIN_FILENO) : open(filename, O_RDONLY);
+	if (fd < 0) {
+		perror("Error opening file");
+		return NULL;
+	}
+	struct traceReader* r = calloc(1, sizeof(struct traceReader));
+	if (!r) _exit(1); // Exit if the memory allocation fails
+	r->fd = -1;
+	for (int i = 0; i < TRACE_BUFFERS; i++) {
+		if (posix_memalign((void**) &r->buffers[i].data, TRACE_ALIGNMENT, TRACE_BUFFER_SIZE) != 0)
+			_exit(1); // Exit if the memory allocation fails
+	}
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	if (live) {
+		r->fd = fd;
+		r->live = 1;
+		return r;
+	}
+
+	// A pipe cannot be read at offsets, so it goes through zlib, which passes plain text through unchanged
+	unsigned char magic[2] = {0};
+	int seekable = lseek(fd, 0, SEEK_CUR) >= 0;
+	if (seekable && (pread(fd, magic, 2, 0) != 2 || magic[0] != 0x1f || magic[1] != 0x8b)) {
+		r->fd = fd;
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#ifdef HAVE_LIBURING
+		if (ringStart(r))
+			return r;
+#endif
+		for (; r->threadCt < TRACE_READ_THREADS; r->threadCt++) {
+			if (pthread_create(&r->threads[r->threadCt], NULL, readBlocks, r) != 0) {
+				perror("Error starting read thread");
+				_exit(1);
+			}
+		}
+		return r;
+	}
+
+	r->gz = gzdopen(fd, "rb");
+	if (r->gz == NULL) {
+		perror("Error opening file");
+		close(fd);
+		trace_close(r);
+		return NULL;
+	}
+	gzbuffer(r->gz, TRACE_BUFFER_SIZE / 4);
+	if (pthread_create(&r->threads[0], NULL, decompress, r) != 0) {
+		perror("Error starting decompression thread");
+		_exit(1);
+	}
+	r->threadCt = 1;
+	return r;
+}
+
+/**
+ * Function for reading text already in memory (such as blocks of a trace read through its index) as a trace. The
+ * text is not copied, so it must outlive the reader.
+ */
+struct traceReader* trace_open_memory(const char* data, size_t len) {
+	struct traceReader* r = calloc(1, sizeof(struct traceReader));
+	if (!r) _exit(1); // Exit if the memory allocation fails
+	r->fd = -1;
+	pthread_mutex_init(&r->lock, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	// The text is the last buffer of the trace (buffers[0] is empty), so reading past it returns EOF
+	r->reading = 1;
+	r->start = data;
+	r->pos = data;
+	r->end = data + len;
+	return r;
+}
+
+/**
+ * Function for moving to the next buffer once the current one has been read, and handing the read one back to be
+ * filled again. Returns the first character of the next buffer, or EOF at the end of the trace.
+ */
+int trace_refill(struct traceReader* r) {
+	struct traceBuffer* b;
+	if (r->live) {
+		// Standard input is read into the first buffer, whatever has arrived being returned at once
+		r->base += r->end - r->start;
+		ssize_t n = 0;
+		while (!r->eof && (n = read(r->fd, r->buffers[0].data, TRACE_BUFFER_SIZE)) < 0 && errno == EINTR);
+		if (n < 0)
+			perror("Error reading trace"); // The trace then ends at the last byte which could be read
+		r->start = r->pos = r->end = r->buffers[0].data;
+		if (n <= 0) {
+			r->eof = 1;
+			return EOF;
+		}
+		r->end += n;
+		return (unsigned char) *r->pos++;
+	}
+#ifdef HAVE_LIBURING
+	if (r->ring != NULL) {
+		if (r->reading) {
+			// The end of the trace stays in its buffer, so later calls keep returning EOF
+			if (r->buffers[r->current].len < TRACE_BUFFER_SIZE)
+				return EOF;
+			r->base += TRACE_BUFFER_SIZE;
+			r->buffers[r->current].state = BUFFER_FREE;
+			if (!r->eof)
+				ringRead(r, &r->buffers[r->current]);
+			r->current = (r->current + 1) % TRACE_BUFFERS;
+		}
+		b = &r->buffers[r->current];
+		while (b->state != BUFFER_FULL)
+			ringComplete(r);
+		r->reading = 1;
+		r->start = b->data;
+		r->pos = b->data;
+		r->end = b->data + b->len;
+		if (b->len == 0) return EOF;
+		return (unsigned char) *r->pos++;
+	}
+#endif
+	pthread_mutex_lock(&r->lock);
+	if (r->reading) {
+		// The end of the trace stays in its buffer, so later calls keep returning EOF
+		if (r->buffers[r->current].len < TRACE_BUFFER_SIZE) {
+			pthread_mutex_unlock(&r->lock);
+			return EOF;
+		}
+		r->base += TRACE_BUFFER_SIZE;
+		r->buffers[r->current].state = BUFFER_FREE;
+		r->current = (r->current + 1) % TRACE_BUFFERS;
+		pthread_cond_broadcast(&r->cond);
+	}
+	b = &r->buffers[r->current];
+	while (b->state != BUFFER_FULL)
+		pthread_cond_wait(&r->cond, &r->lock);
+	r->reading = 1;
+	pthread_mutex_unlock(&r->lock);
+	r->start = b->data;
+	r->pos = b->data;
+	r->end = b->data + b->len;
+	if (b->len == 0) return EOF;
+	return (unsigned char) *r->pos++;
+}
+
+/**
+ * Function for closing a trace, stopping its reads if the trace was not read to the end.
+ */
+void trace_close(struct traceReader* r) {
+#ifdef HAVE_LIBURING
+	if (r->ring != NULL)
+		ringStop(r);
+#endif
+	pthread_mutex_lock(&r->lock);
+	r->stop = 1;
+	pthread_cond_broadcast(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+	for (int i = 0; i < r->threadCt; i++)
+		pthread_join(r->threads[i], NULL);
+	if (r->fd >= 0)
+		close(r->fd);
+	if (r->gz != NULL)
+		gzclose(r->gz);
+	pthread_mutex_destroy(&r->lock);
+	pthread_cond_destroy(&r->cond);
+	for (int i = 0; i < TRACE_BUFFERS; i++)
+		free(r->buffers[i].data);
+	free(r);
+}
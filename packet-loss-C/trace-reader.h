@@ -0,0 +1,64 @@
+/**
+ * Buffered reader of trace files, which the parser reads a character at a time. The trace is read ahead into a ring
+ * of TRACE_BUFFERS buffers: the parser reads one buffer while the next ones are filled, so I/O overlaps with parsing.
+ * Plain traces are read in TRACE_BUFFER_SIZE blocks at aligned offsets, with a read of each free buffer in flight,
+ * which keeps slow or network storage busy. The reads go through io_uring when built with -DHAVE_LIBURING -luring
+ * (as build.sh does when liburing is installed), and through a pool of read threads otherwise or when the kernel
+ * refuses io_uring. A gzip-compressed trace is decompressed on a separate thread into the ring, so no decompressed
+ * copy is written to disk. A trace named - is read from standard input as it arrives, each read being parsed at once
+ * rather than waiting for a full buffer (so it is not decompressed; pipe it through zcat). Lines simply continue from
+ * one buffer into the next.
+ */
+
+#define TRACE_BUFFER_SIZE (1 << 20)
+#define TRACE_BUFFERS 4
+#define TRACE_READ_THREADS (TRACE_BUFFERS - 1) // Threads reading a plain trace without io_uring (one read per buffer not being parsed)
+#define TRACE_ALIGNMENT 4096 // Alignment of the buffers in memory (the blocks are aligned in the file by their size)
+
+enum bufferState {
+	BUFFER_FREE, // Read by the parser, or not used yet
+	BUFFER_FILLING, // Being read or decompressed into
+	BUFFER_FULL // Ready for the parser
+};
+
+struct traceBuffer {
+	char* data;
+	size_t len; // Bytes in the buffer; less than TRACE_BUFFER_SIZE only at the end of the trace
+	enum bufferState state;
+	off_t offset; // Position of the block in a plain trace
+};
+
+struct traceReader {
+	const char* pos; // Next unread character of the current buffer
+	const char* end; // End of the current buffer
+	const char* start; // Start of the current buffer
+	off_t base; // Position of the current buffer in the trace
+	int fd; // Plain trace, or -1
+	int live; // Whether the trace is standard input, parsed as it arrives
+	void* gz; // gzFile of a compressed trace, or NULL
+	void* ring; // struct io_uring reading a plain trace, or NULL
+	struct traceBuffer buffers[TRACE_BUFFERS];
+	unsigned int current; // Buffer the parser is reading
+	int reading; // Whether the parser holds the current buffer
+	off_t nextOffset; // Next block of a plain trace to read
+	int eof; // Set once a read has reached the end of the trace
+	int stop; // Set when the reader is closed before the end of the trace
+	int threadCt;
+	pthread_t threads[TRACE_READ_THREADS];
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+// Returns the next character of the trace, or EOF at its end
+#define trace_getc(r) ((r)->pos < (r)->end ? (unsigned char) *(r)->pos++ : trace_refill(r))
+
+// Returns the position in the trace of the next character to be read
+#define trace_offset(r) ((r)->base + ((r)->pos - (r)->start))
+
+// Puts back the character just read (only valid right after trace_getc() returned one)
+#define trace_unget(r) ((r)->pos--)
+
+struct traceReader* trace_open(const char* filename);
+struct traceReader* trace_open_memory(const char* data, size_t len);
+int trace_refill(struct traceReader* r);
+void trace_close(struct traceReader* r);
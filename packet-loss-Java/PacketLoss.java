@@ -1,20 +1,17 @@
-import java.util.ArrayList;
-import java.util.Set;
-import java.util.HashSet;
-import java.util.HashMap;
-import java.util.Iterator;
-import java.util.Collections;
-import java.util.List;
 import java.util.Arrays;
-import java.util.Scanner;
 
-import java.io.File;
+import java.io.Closeable;
 import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.channels.FileChannel;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Paths;
+import java.nio.file.StandardOpenOption;
 
 public class PacketLoss {
-	HashMap<Long, Long> connectionsDict = new HashMap<>();
-	HashMap<Long, HashMap<Long, oOSPacket>> outOfSeq = new HashMap<>(); //hashmap of packets that are out of sequence
-	ArrayList<Long> closedConnections = new ArrayList<Long>(); //record of connections which have all packets accounted for in sequence and closed
+	LongLongMap connectionsDict = new LongLongMap();
+	LongObjectMap<LongObjectMap<oOSPacket>> outOfSeq = new LongObjectMap<>(); //hashmap of packets that are out of sequence
+	LongLongMap closedConnections = new LongLongMap(); //record (as a set) of connections which have all packets accounted for in sequence and closed
 	static String defaultFile = "trace-small.txt";
 	//int counter = 0;
 	int packetCounter = 0;
@@ -29,8 +26,8 @@ public class PacketLoss {
 	}
 	
 	/**
-	 * Function for analysing the trace file data and identifying packet loss. Instantiates a Tracefile object containing
-	 * the data and checks the sequence of packets by their TCP sequence number. If packets are out-of-sequence ("oOS"),
+	 * Function for analysing the trace file data and identifying packet loss. Streams the trace file through a TraceReader
+	 * one line at a time and checks the sequence of packets by their TCP sequence number. If packets are out-of-sequence ("oOS"),
 	 * stores them in a hashmap for further sequencing.
 	 * 
 	 * Prints summary information. Missing packets are identified using the oOS hashmap after processing, whereby those 
@@ -38,55 +35,28 @@ public class PacketLoss {
 	 * @param filename takes a filename string
 	 */	
 	public void parse(String filename) {
-		File f = new File(filename);
-		TraceData traceInput = new TraceData(f);
-		for (int i = 0; i < traceInput.traceLines.size(); i++) {
-			String[] line = traceInput.traceLines.get(i);
-			if (line[2].isEmpty() || line[3].isEmpty() || line[4].isEmpty() || line[5].isEmpty()) //if any IP or ports are empty, skip
-				continue;
-			long connID = makeLongID(line);
-			long seqNum = Long.parseLong(line[13]);
-			packetCounter += 1;
-			byteCounter += Long.parseLong(line[8]) + Long.parseLong(line[11]);
-			//counter += 1;
-			//if (counter % 10000 == 0) 
-			//	System.out.println(counter + " lines parsed.");
-			//if (!outOfSeq.isEmpty()) {
-			//	System.out.println("OutOfSeq packet(s) from:");
-			//	for (long key: outOfSeq.keySet())
-			//		System.out.println(key + " " + outOfSeq.get(key));
-			//}
-			
-			if (connectionsDict.containsKey(connID) && seqNum == connectionsDict.get(connID)) {
-				updateSeqNum(connectionsDict.get(connID), seqNum + Integer.parseInt(line[8]) + Integer.parseInt(line[11]), 
-							connID, Integer.parseInt(line[14]));
-				
-			} else if (seqNum == 0) {//Handle new connections
-				connectionCounter += 1;
-				connectionsDict.put(connID, 1L);
-			} else { //Handle out-of-sequence packets
-				if (!outOfSeq.containsKey(connID)) 
-					outOfSeq.put(connID, new HashMap<>()); //add connection and new HashMap to outOfSeq HashMap
-				outOfSeq.get(connID).put(seqNum, new oOSPacket(seqNum, seqNum + Integer.parseInt(line[8]) + Integer.parseInt(line[11]), Integer.parseInt(line[14]), Double.parseDouble(line[1])));
-				// add TCP sequence number as key, add next TCP sequence number & connection close flag as value array
+		try (TraceReader line = new TraceReader(filename)) {
+			while (line.nextLine()) {
+				handleLine(line);
 			}
+		} catch (IOException ioExc) {
+			// check if file isn't readable; report on whatever was read
 		}
 
 		/* Final printout */
-		for (long closedConn: closedConnections) { //clean up duplicate packets of closed connections still in outOfSeq
+		for (long closedConn: closedConnections.keys()) { //clean up duplicate packets of closed connections still in outOfSeq
 			if (outOfSeq.containsKey(closedConn))
 				outOfSeq.remove(closedConn);
 		}
-		for (Iterator<Long> conns = outOfSeq.keySet().iterator(); conns.hasNext();) { //clean up duplicate packets which are already sequenced in a connection
-			long connection = conns.next();
+		for (long connection: outOfSeq.keys()) { //clean up duplicate packets which are already sequenced in a connection
 			if (connectionsDict.containsKey(connection)) {
-				for (Iterator<Long> packets = outOfSeq.get(connection).keySet().iterator(); packets.hasNext();) {
-					Long packet = packets.next();
+				LongObjectMap<oOSPacket> packets = outOfSeq.get(connection);
+				for (long packet: packets.keys()) {
 					if (packet < connectionsDict.get(connection)) 
-						packets.remove();
+						packets.remove(packet);
 				}
-				if (outOfSeq.get(connection).isEmpty())
-					conns.remove();
+				if (packets.isEmpty())
+					outOfSeq.remove(connection);
 			}
 		}
 
@@ -94,10 +64,10 @@ public class PacketLoss {
 		if (connectionsDict.isEmpty() && outOfSeq.isEmpty()) {
 			System.out.println("None");
 		} else {
-			Set<Long> keyList = new HashSet(connectionsDict.keySet());
-			keyList.addAll(outOfSeq.keySet());
+			long[] keyList = unionSorted(connectionsDict.keys(), outOfSeq.keys());
 			for (long key: keyList)
-				System.out.println(longToString(key) + ((!connectionsDict.isEmpty()) ? (" expecting packet " + connectionsDict.get(key)) : ""));
+				System.out.println(longToString(key) + ((!connectionsDict.isEmpty()) ? (" expecting packet " + 
+						(connectionsDict.containsKey(key) ? String.valueOf(connectionsDict.get(key)) : "null")) : ""));
 		}
 		// System.out.print("\nRemaining orphaned out-of-sequence packets:");
 		// if (outOfSeq.isEmpty()) {
@@ -112,38 +82,44 @@ public class PacketLoss {
 		// }
 		
 		if (!outOfSeq.isEmpty()) {
-			
-			for (long connection: outOfSeq.keySet()) { //for each connection with out-of-sequence packets
-				Set<Long> keySetCopy = outOfSeq.get(connection).keySet();
-				long nextSeqNum = Collections.min(keySetCopy);
+			long[] connections = outOfSeq.keys();
+			Arrays.sort(connections);
+			for (long connection: connections) { //for each connection with out-of-sequence packets
+				LongObjectMap<oOSPacket> packets = outOfSeq.get(connection);
+				long[] seqNums = packets.keys();
+				Arrays.sort(seqNums);
+				int minIndex = 0; //index in seqNums of the smallest sequence number still in packets
+				long nextSeqNum = seqNums[minIndex];
 				long prevSeqNum;
 				System.out.println("\nMissing bytes from connection " + longToString(connection) + " as follows:");
 				//calculate missing bytes between sequenced packets and first oOS packet
 				if (!connectionsDict.containsKey(connection)) { 
 					missingBytes += nextSeqNum;
 					System.out.println(nextSeqNum + " missing bytes between start of connection and TCP sequence number " + nextSeqNum + 
-										" at time " + outOfSeq.get(connection).get(nextSeqNum).getTimeStamp());
-					//nextSeqNum = outOfSeq.get(connection).get(nextSeqNum).getNextSeqNum();
+										" at time " + packets.get(nextSeqNum).getTimeStamp());
+					//nextSeqNum = packets.get(nextSeqNum).getNextSeqNum();
 				} else {
 					missingBytes += nextSeqNum - connectionsDict.get(connection);
 					System.out.println((nextSeqNum - connectionsDict.get(connection))+ " missing bytes between TCP sequence numbers " + connectionsDict.get(connection) + " and " + nextSeqNum + 
-										" at time " + outOfSeq.get(connection).get(nextSeqNum).getTimeStamp());
+										" at time " + packets.get(nextSeqNum).getTimeStamp());
 				}
 
 				//calculate missing bytes between oOS packets
-				while (!keySetCopy.isEmpty()) {
+				while (!packets.isEmpty()) {
 					do {
 						prevSeqNum = nextSeqNum;
-						nextSeqNum = outOfSeq.get(connection).get(prevSeqNum).getNextSeqNum();
-						keySetCopy.remove(prevSeqNum);
-					} while (outOfSeq.get(connection).containsKey(nextSeqNum));
+						nextSeqNum = packets.get(prevSeqNum).getNextSeqNum();
+						packets.remove(prevSeqNum);
+					} while (packets.containsKey(nextSeqNum));
 					
-					if (!keySetCopy.isEmpty()) {
+					if (!packets.isEmpty()) {
 						prevSeqNum = nextSeqNum;
-						nextSeqNum = Collections.min(keySetCopy);
+						while (!packets.containsKey(seqNums[minIndex]))
+							minIndex++;
+						nextSeqNum = seqNums[minIndex];
 						missingBytes += nextSeqNum - prevSeqNum;
 						System.out.println((nextSeqNum - prevSeqNum) + " missing bytes between TCP sequence numbers " + prevSeqNum + " and " + nextSeqNum + 
-											" at time " + outOfSeq.get(connection).get(nextSeqNum).getTimeStamp());
+											" at time " + packets.get(nextSeqNum).getTimeStamp());
 					}
 				}
 				
@@ -154,7 +130,49 @@ public class PacketLoss {
 		System.out.printf("%d / %d bytes missing from trace sequence (%.2f%% loss).%n%n", missingBytes, byteCounter, missingBytes / (double) byteCounter);
 		System.out.println("Subsequent missing packets from " + connectionsDict.size() + " connections could not be determined.\n");
 	}
-	
+
+	/**
+	 * Function for sequencing a single line of the trace file as it is streamed in. Lines with any IP or port empty
+	 * (or too few fields, such as a trailing blank line) are skipped.
+	 * @param line TraceReader positioned on the current line
+	 */	
+	private void handleLine(TraceReader line) {
+		if (line.fieldCount() < 15) //blank or truncated line, skip
+			return;
+		if (line.isEmpty(2) || line.isEmpty(3) || line.isEmpty(4) || line.isEmpty(5)) //if any IP or ports are empty, skip
+			return;
+		long connID = makeLongID(line);
+		long seqNum = line.getLong(13);
+		int payloadSize = line.getInt(8);
+		int finFlag = line.getInt(11);
+		packetCounter += 1;
+		byteCounter += payloadSize + finFlag;
+		//counter += 1;
+		//if (counter % 10000 == 0) 
+		//	System.out.println(counter + " lines parsed.");
+		//if (!outOfSeq.isEmpty()) {
+		//	System.out.println("OutOfSeq packet(s) from:");
+		//	for (long key: outOfSeq.keySet())
+		//		System.out.println(key + " " + outOfSeq.get(key));
+		//}
+		
+		if (connectionsDict.containsKey(connID) && seqNum == connectionsDict.get(connID)) {
+			updateSeqNum(connectionsDict.get(connID), seqNum + payloadSize + finFlag, 
+						connID, line.getInt(14));
+			
+		} else if (seqNum == 0) {//Handle new connections
+			connectionCounter += 1;
+			connectionsDict.put(connID, 1L);
+		} else { //Handle out-of-sequence packets
+			LongObjectMap<oOSPacket> packets = outOfSeq.get(connID);
+			if (packets == null) {
+				packets = new LongObjectMap<>();
+				outOfSeq.put(connID, packets); //add connection and new map to outOfSeq map
+			}
+			packets.put(seqNum, new oOSPacket(seqNum, seqNum + payloadSize + finFlag, line.getInt(14), line.getDouble(1)));
+			// add TCP sequence number as key, add next TCP sequence number & connection close flag as value array
+		}
+	}
 
 	/**
 	 * Function for creating a 64-bit long identifier for each connection. The 64-bits are allocated as follows:
@@ -164,21 +182,36 @@ public class PacketLoss {
 	 * Dest port: 16 bits
 	 * NOTE: This implementation assumes source IP always starts with "192.168." and dest IP always 
 	 * starts with "10.0." so only last 16 bits are used to identify IP addresses.
-	 * @param line String array from a line of the trace file
+	 * @param line TraceReader positioned on a line of the trace file
 	 */	
-	public long makeLongID(String[] line) {
+	public long makeLongID(TraceReader line) {
 		long longID;
-        String[] sourceIP = line[2].split("\\.");
-        String[] destIP = line[4].split("\\.");
-		longID = 	Long.parseLong(sourceIP[2]) * 0x0100000000000000L +
-					Long.parseLong(sourceIP[3]) * 0x0001000000000000L +
-					Long.parseLong(line[3]) * 0x0000000100000000L +
-					Long.parseLong(destIP[2]) * 0x0000000001000000L +
-					Long.parseLong(destIP[3]) * 0x0000000000010000L +
-					Long.parseLong(line[5]);
+		longID = 	line.getIPOctet(2, 2) * 0x0100000000000000L +
+					line.getIPOctet(2, 3) * 0x0001000000000000L +
+					line.getLong(3) * 0x0000000100000000L +
+					line.getIPOctet(4, 2) * 0x0000000001000000L +
+					line.getIPOctet(4, 3) * 0x0000000000010000L +
+					line.getLong(5);
 		return longID;
 	}
 
+	/**
+	 * Function for merging two arrays of connection IDs into one sorted array without duplicates.
+	 * @param a first array of connection IDs
+	 * @param b second array of connection IDs
+	 */	
+	private static long[] unionSorted(long[] a, long[] b) {
+		long[] all = Arrays.copyOf(a, a.length + b.length);
+		System.arraycopy(b, 0, all, a.length, b.length);
+		Arrays.sort(all);
+		int count = 0;
+		for (int i = 0; i < all.length; i++) {
+			if (count == 0 || all[i] != all[count - 1])
+				all[count++] = all[i];
+		}
+		return Arrays.copyOf(all, count);
+	}
+
 	/**
 	 * Function for changing the connection long ID to a human readable string.
 	 * @param longID long number representing the connection IPs and ports
@@ -205,12 +238,13 @@ public class PacketLoss {
 	 */	
 	public void updateSeqNum(long seqNum, long nextSeqNum, long connID, int closedFlag) {
 		//System.out.println("For " + connID + " " + connectionsDict.get(connID) + " is replaced by " + nextSeqNum);
-		connectionsDict.replace(connID, nextSeqNum); //update value to next expected TCP sequence num
+		connectionsDict.put(connID, nextSeqNum); //update value to next expected TCP sequence num
 		
 		//after updating, check if any outOfSeq packets can be reordered
-		if (outOfSeq.containsKey(connID) && outOfSeq.get(connID).containsKey(nextSeqNum)) {
-			oOSPacket outOfSeqInfo = outOfSeq.get(connID).remove(nextSeqNum); //remove the reordered packet info from outOfSeq
-			if (outOfSeq.get(connID).isEmpty())
+		LongObjectMap<oOSPacket> packets = outOfSeq.get(connID);
+		if (packets != null && packets.containsKey(nextSeqNum)) {
+			oOSPacket outOfSeqInfo = packets.remove(nextSeqNum); //remove the reordered packet info from outOfSeq
+			if (packets.isEmpty())
 				outOfSeq.remove(connID); //remove the connection from outOfSeq if no more outOfSeq packets
 			//System.out.println(nextSeqNum + " packet from " + connID + " which was out of sequence, removed from outOfSeq HashMap");
 			updateSeqNum(nextSeqNum, outOfSeqInfo.getNextSeqNum(), connID, outOfSeqInfo.getFinFlag());
@@ -218,7 +252,7 @@ public class PacketLoss {
 		if (closedFlag == 2) {
 			//System.out.println(connID + " closed");
 			connectionsDict.remove(connID); //remove connection if closed from in-sequence packet
-			closedConnections.add(connID);
+			closedConnections.put(connID, 1L);
 		}
 	}
 
@@ -260,29 +294,374 @@ private class oOSPacket {
 }
 
 /**
- * TraceData inner class to handle the instantiating and preparation of data from the trace file.
+ * TraceReader inner class to stream the trace file through a FileChannel into one large reusable buffer. Each line is
+ * split into tab separated fields in place, and fields are decoded straight from the bytes, so memory stays flat
+ * however large the trace is.
  */
-	private class TraceData {
-		private ArrayList<String[]> traceLines = new ArrayList<String[]>();
+	private static class TraceReader implements Closeable {
+		private static final int BUFFER_SIZE = 1 << 20;
+		private static final int MAX_FIELDS = 16;
+		private final FileChannel channel;
+		private ByteBuffer buffer = ByteBuffer.allocate(BUFFER_SIZE);
+		private byte[] bytes = buffer.array();
+		private int position = 0; // start of the next unread line
+		private int limit = 0; // end of the data read into the buffer
+		private boolean endOfFile = false;
+		private final int[] fieldStart = new int[MAX_FIELDS];
+		private final int[] fieldEnd = new int[MAX_FIELDS];
+		private int fieldCount = 0;
+
+	/**
+	 * Constructor for TraceReader object. Opens the input file of trace data for reading.
+	 * @param filename input file of the trace data.
+	 */
+		private TraceReader(String filename) throws IOException {
+			channel = FileChannel.open(Paths.get(filename), StandardOpenOption.READ);
+		}
 
 	/**
-	 * Constructor for TraceData object. Takes the input file of trace data and uses a scanner object to 
-	 * split the input data into String arrays for each record and adds it to an ArrayList
-	 * @param f input file of the trace data.
+	 * Advances to the next line of the trace file and splits it into fields. Returns false at the end of the file.
 	 */
-		private TraceData(File f) {
-			Scanner input = null;
-			try {
-				input = new Scanner(f);
+		private boolean nextLine() throws IOException {
+			int scanned = position;
+			while (true) {
+				for (int i = scanned; i < limit; i++) {
+					if (bytes[i] == '\n') {
+						split(position, i);
+						position = i + 1;
+						return true;
+					}
+				}
+				if (endOfFile) {
+					if (position == limit)
+						return false;
+					split(position, limit); // last line without a newline
+					position = limit;
+					return true;
+				}
+				scanned = limit - position;
+				refill();
+			}
+		}
+
+		// Moves the partial line to the front of the buffer and reads more of the file after it
+		private void refill() throws IOException {
+			int remaining = limit - position;
+			if (remaining == bytes.length) { // line longer than the buffer
+				ByteBuffer larger = ByteBuffer.allocate(bytes.length * 2);
+				System.arraycopy(bytes, position, larger.array(), 0, remaining);
+				buffer = larger;
+				bytes = larger.array();
+			} else {
+				System.arraycopy(bytes, position, bytes, 0, remaining);
+			}
+			position = 0;
+			limit = remaining;
+			buffer.clear();
+			buffer.position(limit);
+			int read = channel.read(buffer);
+			if (read < 0)
+				endOfFile = true;
+			else
+				limit += read;
+		}
+
+		private void split(int start, int end) {
+			if (end > start && bytes[end - 1] == '\r')
+				end--;
+			fieldCount = 0;
+			if (end == start)
+				return;
+			fieldStart[0] = start;
+			for (int i = start; i < end; i++) {
+				if (bytes[i] == '\t') {
+					fieldEnd[fieldCount++] = i;
+					if (fieldCount == MAX_FIELDS)
+						return;
+					fieldStart[fieldCount] = i + 1;
+				}
+			}
+			fieldEnd[fieldCount++] = end;
+		}
+
+		private int fieldCount() {
+			return fieldCount;
+		}
+
+		private boolean isEmpty(int field) {
+			return fieldStart[field] == fieldEnd[field];
+		}
+
+		private long getLong(int field) {
+			return parseLong(fieldStart[field], fieldEnd[field]);
+		}
+
+		private int getInt(int field) {
+			return (int) getLong(field);
+		}
+
+		// Time stamps are only decoded for out-of-sequence packets, so they go through Double.parseDouble
+		private double getDouble(int field) {
+			return Double.parseDouble(new String(bytes, fieldStart[field], fieldEnd[field] - fieldStart[field], StandardCharsets.US_ASCII));
+		}
+
+		// Returns the given (0-based) number of the dotted IP address in the field
+		private long getIPOctet(int field, int octet) {
+			int start = fieldStart[field];
+			int end = fieldEnd[field];
+			for (int i = start; i < end; i++) {
+				if (bytes[i] == '.') {
+					if (octet-- == 0)
+						return parseLong(start, i);
+					start = i + 1;
+				}
+			}
+			if (octet == 0)
+				return parseLong(start, end);
+			throw new NumberFormatException("IP address without octet " + octet);
+		}
+
+		private long parseLong(int start, int end) {
+			if (start == end)
+				throw new NumberFormatException("empty field");
+			boolean negative = bytes[start] == '-';
+			long value = 0;
+			for (int i = negative ? start + 1 : start; i < end; i++) {
+				int digit = bytes[i] - '0';
+				if (digit < 0 || digit > 9)
+					throw new NumberFormatException(new String(bytes, start, end - start, StandardCharsets.US_ASCII));
+				value = value * 10 + digit;
+			}
+			return negative ? -value : value;
+		}
+
+		public void close() throws IOException {
+			channel.close();
+		}
+	}
+
+/**
+ * Open addressing hash map from primitive long keys to long values, with linear probing and backward shift deletion,
+ * so that neither keys nor values are boxed.
+ */
+	private static class LongLongMap {
+		private long[] keys = new long[16]; // 0 marks a free slot; key 0 itself is kept aside
+		private long[] values = new long[16];
+		private int count = 0;
+		private boolean hasZeroKey = false;
+		private long zeroValue;
+
+		private static int hash(long key, int mask) {
+			long h = key * 0x9E3779B97F4A7C15L;
+			return (int) (h ^ (h >>> 32)) & mask;
+		}
+
+		private int indexOf(long key) {
+			int mask = keys.length - 1;
+			for (int i = hash(key, mask); keys[i] != 0; i = (i + 1) & mask) {
+				if (keys[i] == key)
+					return i;
+			}
+			return -1;
+		}
+
+		private boolean containsKey(long key) {
+			return (key == 0) ? hasZeroKey : indexOf(key) >= 0;
+		}
+
+		// Returns the value for the key, or 0 if the key is absent
+		private long get(long key) {
+			if (key == 0)
+				return hasZeroKey ? zeroValue : 0;
+			int i = indexOf(key);
+			return (i < 0) ? 0 : values[i];
+		}
+
+		private void put(long key, long value) {
+			if (key == 0) {
+				hasZeroKey = true;
+				zeroValue = value;
+				return;
+			}
+			if ((count + 1) * 2 > keys.length)
+				resize(keys.length * 2);
+			int mask = keys.length - 1;
+			int i = hash(key, mask);
+			while (keys[i] != 0 && keys[i] != key)
+				i = (i + 1) & mask;
+			if (keys[i] == 0)
+				count++;
+			keys[i] = key;
+			values[i] = value;
+		}
+
+		private void remove(long key) {
+			if (key == 0) {
+				hasZeroKey = false;
+				return;
+			}
+			int i = indexOf(key);
+			if (i < 0)
+				return;
+			count--;
+			int mask = keys.length - 1;
+			// Shift back the entries after the removed one which would no longer be reachable
+			for (int j = (i + 1) & mask; keys[j] != 0; j = (j + 1) & mask) {
+				int home = hash(keys[j], mask);
+				if (((j - home) & mask) >= ((j - i) & mask)) {
+					keys[i] = keys[j];
+					values[i] = values[j];
+					i = j;
+				}
+			}
+			keys[i] = 0;
+		}
+
+		private void resize(int capacity) {
+			long[] oldKeys = keys;
+			long[] oldValues = values;
+			keys = new long[capacity];
+			values = new long[capacity];
+			count = 0;
+			for (int i = 0; i < oldKeys.length; i++) {
+				if (oldKeys[i] != 0)
+					put(oldKeys[i], oldValues[i]);
+			}
+		}
+
+		private int size() {
+			return count + (hasZeroKey ? 1 : 0);
+		}
+
+		private boolean isEmpty() {
+			return size() == 0;
+		}
+
+		// Returns a snapshot of the keys, so the map can be changed while iterating over them
+		private long[] keys() {
+			long[] result = new long[size()];
+			int n = 0;
+			if (hasZeroKey)
+				result[n++] = 0;
+			for (long key: keys) {
+				if (key != 0)
+					result[n++] = key;
 			}
-			catch (IOException ioExc) {
-				return; // check if file isn't readable;
+			return result;
+		}
+	}
+
+/**
+ * Open addressing hash map from primitive long keys to objects, laid out like LongLongMap.
+ */
+	private static class LongObjectMap<V> {
+		private long[] keys = new long[8];
+		private Object[] values = new Object[8];
+		private int count = 0;
+		private boolean hasZeroKey = false;
+		private V zeroValue;
+
+		private int indexOf(long key) {
+			int mask = keys.length - 1;
+			for (int i = LongLongMap.hash(key, mask); keys[i] != 0; i = (i + 1) & mask) {
+				if (keys[i] == key)
+					return i;
+			}
+			return -1;
+		}
+
+		private boolean containsKey(long key) {
+			return (key == 0) ? hasZeroKey : indexOf(key) >= 0;
+		}
+
+		// Returns the value for the key, or null if the key is absent
+		@SuppressWarnings("unchecked")
+		private V get(long key) {
+			if (key == 0)
+				return hasZeroKey ? zeroValue : null;
+			int i = indexOf(key);
+			return (i < 0) ? null : (V) values[i];
+		}
+
+		private void put(long key, V value) {
+			if (key == 0) {
+				hasZeroKey = true;
+				zeroValue = value;
+				return;
 			}
-			while (input.hasNext()) {
-				String currentLine = input.nextLine();
-				traceLines.add(currentLine.split("\t"));
+			if ((count + 1) * 2 > keys.length)
+				resize(keys.length * 2);
+			int mask = keys.length - 1;
+			int i = LongLongMap.hash(key, mask);
+			while (keys[i] != 0 && keys[i] != key)
+				i = (i + 1) & mask;
+			if (keys[i] == 0)
+				count++;
+			keys[i] = key;
+			values[i] = value;
+		}
+
+		// Removes the key and returns its value, or null if the key is absent
+		private V remove(long key) {
+			V removed;
+			if (key == 0) {
+				removed = hasZeroKey ? zeroValue : null;
+				hasZeroKey = false;
+				zeroValue = null;
+				return removed;
+			}
+			int i = indexOf(key);
+			if (i < 0)
+				return null;
+			removed = get(key);
+			count--;
+			int mask = keys.length - 1;
+			// Shift back the entries after the removed one which would no longer be reachable
+			for (int j = (i + 1) & mask; keys[j] != 0; j = (j + 1) & mask) {
+				int home = LongLongMap.hash(keys[j], mask);
+				if (((j - home) & mask) >= ((j - i) & mask)) {
+					keys[i] = keys[j];
+					values[i] = values[j];
+					i = j;
+				}
+			}
+			keys[i] = 0;
+			values[i] = null;
+			return removed;
+		}
+
+		@SuppressWarnings("unchecked")
+		private void resize(int capacity) {
+			long[] oldKeys = keys;
+			Object[] oldValues = values;
+			keys = new long[capacity];
+			values = new Object[capacity];
+			count = 0;
+			for (int i = 0; i < oldKeys.length; i++) {
+				if (oldKeys[i] != 0)
+					put(oldKeys[i], (V) oldValues[i]);
+			}
+		}
+
+		private int size() {
+			return count + (hasZeroKey ? 1 : 0);
+		}
+
+		private boolean isEmpty() {
+			return size() == 0;
+		}
+
+		// Returns a snapshot of the keys, so the map can be changed while iterating over them
+		private long[] keys() {
+			long[] result = new long[size()];
+			int n = 0;
+			if (hasZeroKey)
+				result[n++] = 0;
+			for (long key: keys) {
+				if (key != 0)
+					result[n++] = key;
 			}
-			input.close();
+			return result;
 		}
 	}
 
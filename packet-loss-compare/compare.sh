@@ -0,0 +1,157 @@
+#!/bin/sh
+# Differential correctness and speed harness for packet-loss-C and packet-loss-Java.
+# Runs both analyzers on the same traces, diffs their normalized loss reports (see normalize.awk) and reports
+# wall time, throughput and peak resident memory of each. The C report is also diffed against that of its -offline
+# analysis, which sorts the whole trace first and so is not affected by how long connections are kept open. Without
+# traces, the parallel radix sort is checked against the single-threaded one (bench/radix-bench.c), and the -diff
+# report of diff-retransmit-a/b.txt against diff-retransmit.expected.
+#
+# Usage: ./compare.sh [-n] [trace ...]
+#   With no traces, runs on packet-loss-Java/test1-5.txt and trace-small2.txt plus generated large traces (skipped with -n).
+# Exits with status 1 if the analyzers disagree on any trace, and 2 if either analyzer fails to build.
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+ROOT=$(dirname "$HERE")
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+GENERATE=1
+if [ "${1:-}" = "-n" ]; then
+	GENERATE=0
+	shift
+fi
+
+# Build both analyzers
+if ! gcc -O2 -o "$WORK/PacketLoss" "$ROOT"/packet-loss-C/*.c -lm -lpthread -lz; then
+	echo "Error: building packet-loss-C failed" >&2
+	exit 2
+fi
+JAVA=0
+if command -v javac > /dev/null 2>&1 && command -v java > /dev/null 2>&1; then
+	mkdir "$WORK/java"
+	if ! javac -d "$WORK/java" "$ROOT/packet-loss-Java/PacketLoss.java"; then
+		echo "Error: building packet-loss-Java failed" >&2
+		exit 2
+	fi
+	JAVA=1
+fi
+[ $JAVA = 1 ] || echo "javac/java not found: only timing packet-loss-C"
+
+# Traces to run
+if [ $# -gt 0 ]; then
+	TRACES="$*"
+else
+	TRACES="$ROOT/packet-loss-Java/test1.txt $ROOT/packet-loss-Java/test2.txt $ROOT/packet-loss-Java/test3.txt $ROOT/packet-loss-Java/test4.txt $ROOT/packet-loss-Java/test5.txt"
+	TRACES="$TRACES $ROOT/packet-loss-Java/trace-small2.txt"
+	if [ $GENERATE = 1 ]; then
+		echo "Generating large traces..."
+		awk -v flows=20000 -v packets=200000 -v seed=1 -f "$HERE/gen-trace.awk" > "$WORK/gen-200k.txt"
+		awk -v flows=200000 -v packets=2000000 -v seed=2 -f "$HERE/gen-trace.awk" > "$WORK/gen-2m.txt"
+		TRACES="$TRACES $WORK/gen-200k.txt $WORK/gen-2m.txt"
+	fi
+fi
+
+# Runs a command in the background, sampling its VmHWM (peak resident set) until it exits.
+# Sets ELAPSED (seconds) and PEAK_KB.
+run_measured() {
+	out=$1
+	shift
+	start=$(date +%s.%N)
+	"$@" > "$out" 2>&1 &
+	pid=$!
+	PEAK_KB=0
+	while kill -0 $pid 2> /dev/null; do
+		hwm=$(awk '/^VmHWM/ { print $2 }' /proc/$pid/status 2> /dev/null)
+		if [ -n "$hwm" ] && [ "$hwm" -gt "$PEAK_KB" ]; then PEAK_KB=$hwm; fi
+		sleep 0.02
+	done
+	wait $pid
+	status=$?
+	end=$(date +%s.%N)
+	ELAPSED=$(echo "$start $end" | awk '{ printf "%.3f", $2 - $1 }')
+	return $status
+}
+
+report_line() {
+	# impl, trace bytes, packets
+	echo "$ELAPSED $1 $2 $PEAK_KB $3" | awk '{
+		secs = ($1 > 0) ? $1 : 0.001
+		printf "  %-5s %8.3f s %9.1f MB/s %11.0f packets/s %9.1f MB peak\n", $2, $1, $3 / 1048576 / secs, $5 / secs, $4 / 1024
+	}'
+}
+
+FAILED=0
+cd "$WORK" || exit 2
+for trace in $TRACES; do
+	name=$(basename "$trace" .txt)
+	# The C analyzer names its report after its argument, so run it on a short local name
+	[ -e "$name.txt" ] || ln -s "$trace" "$name.txt"
+	size=$(wc -c < "$trace")
+	echo "$name ($size bytes):"
+
+	run_measured "$name.c.out" ./PacketLoss "$name.txt" || echo "  C analyzer exited with an error"
+	awk -f "$HERE/normalize.awk" "$name-PacketLoss.txt" 2> /dev/null | sort > "$name.c.norm"
+	report_line C "$size" "$(awk '$1 == "packets" { print $2 }' "$name.c.norm")"
+
+	./PacketLoss -offline "$name.txt" > "$name.offline.out" 2>&1 || echo "  C offline analysis exited with an error"
+	awk -f "$HERE/normalize.awk" "$name-PacketLoss.txt" 2> /dev/null | sort > "$name.offline.norm"
+	if ! diff "$name.c.norm" "$name.offline.norm" > "$name.offline.diff"; then
+		FAILED=1
+		echo "  C EXACT AND OFFLINE REPORTS DIFFER (< exact, > offline):"
+		head -20 "$name.offline.diff" | sed 's/^/    /'
+	fi
+
+	if [ $JAVA = 1 ]; then
+		run_measured "$name.java.out" java -cp "$WORK/java" PacketLoss "$name.txt" || echo "  Java analyzer exited with an error"
+		awk -f "$HERE/normalize.awk" "$name.java.out" | sort > "$name.java.norm"
+		report_line Java "$size" "$(awk '$1 == "packets" { print $2 }' "$name.java.norm")"
+		# The analyzers count packets, bytes and connections differently, so only their gaps and missing bytes are
+		# compared
+		grep -E '^(gap|missing) ' "$name.c.norm" > "$name.c.cmp"
+		grep -E '^(gap|missing) ' "$name.java.norm" > "$name.java.cmp"
+		if diff "$name.c.cmp" "$name.java.cmp" > "$name.diff"; then
+			echo "  reports agree ($(grep -c '^gap' "$name.c.norm") gaps)"
+		else
+			FAILED=1
+			echo "  REPORTS DIFFER (< C, > Java):"
+			head -20 "$name.diff" | sed 's/^/    /'
+		fi
+	fi
+done
+
+# The parallel radix sort of the offline analysis must give the same order as the single-threaded one, and skip the
+# same passes
+if [ $# -eq 0 ]; then
+	echo "radix-sort:"
+	if ! gcc -O2 -I"$ROOT/packet-loss-C" -o radix-bench "$ROOT/packet-loss-C/bench/radix-bench.c" "$ROOT/packet-loss-C/radix-sort.c" -lpthread; then
+		echo "Error: building radix-bench failed" >&2
+		exit 2
+	fi
+	if ./radix-bench 200000 4 > radix-bench.out 2>&1; then
+		echo "  parallel sort agrees ($(awk '/^radix_sort:/ { print $(NF - 1) }' radix-bench.out) passes)"
+	else
+		FAILED=1
+		echo "  PARALLEL SORT DIFFERS:"
+		sed 's/^/    /' radix-bench.out
+	fi
+fi
+
+# Diff mode on a pair of captures where a segment lost on the link was retransmitted: the lost copy must be
+# reported missing, and the one-way delay is that of the retransmission
+if [ $# -eq 0 ]; then
+	for side in a b; do
+		[ -e "diff-retransmit-$side.txt" ] || ln -s "$HERE/diff-retransmit-$side.txt" "diff-retransmit-$side.txt"
+	done
+	echo "diff-retransmit:"
+	./PacketLoss -diff diff-retransmit-a.txt diff-retransmit-b.txt > diff-retransmit.out 2>&1 || echo "  C diff exited with an error"
+	grep -E '^(Missing at|A to B|B to A|Seen at)' diff-retransmit-a-PacketDiff.txt > diff-retransmit.got 2> /dev/null
+	if diff "$HERE/diff-retransmit.expected" diff-retransmit.got > diff-retransmit.diff; then
+		echo "  diff report as expected"
+	else
+		FAILED=1
+		echo "  DIFF REPORT DIFFERS (< expected, > C):"
+		head -20 diff-retransmit.diff | sed 's/^/    /'
+	fi
+fi
+
+exit $FAILED
@@ -0,0 +1,59 @@
+# Generates a synthetic tshark trace in the column layout read by both analyzers, with packet loss and reordering.
+# Usage: awk -v flows=20000 -v packets=200000 -v loss=0.01 -v reorder=0.01 -v seed=1 -f gen-trace.awk > trace.txt
+#
+# Columns: frame, time, src IP, src port, dst IP, dst port, frame len, IP len, TCP payload, SYN, ACK, FIN, RST,
+# relative seq num, relative ack num (2 on FIN, which the Java analyzer reads as the close flag), 1.
+
+BEGIN {
+	if (flows == "") flows = 20000
+	if (packets == "") packets = 200000
+	if (loss == "") loss = 0.01
+	if (reorder == "") reorder = 0.01
+	if (seed == "") seed = 1
+	srand(seed)
+	split("1448 1448 1448 536 100 12", sizes, " ")
+
+	for (f = 0; f < flows; f++) {
+		src[f] = sprintf("192.168.%d.%d", int(f / 250) % 256, f % 250 + 1)
+		dst[f] = sprintf("10.0.%d.%d", int(f / 250) % 256, f % 250 + 1)
+		dport[f] = 40000 + f % 20000
+		seq[f] = 0
+		left[f] = 3 + int(rand() * 38) # packets in the flow: SYN, data..., FIN
+		sent[f] = 0
+		alive[f] = f
+	}
+	aliveCt = flows
+	t = 0
+	frame = 1
+	held = ""
+
+	while (aliveCt > 0 && frame <= packets) {
+		i = int(rand() * aliveCt)
+		f = alive[i]
+		t += rand() * 0.001
+		if (sent[f] == 0) {
+			size = 0; syn = 1; fin = 0
+		} else if (left[f] == 1) {
+			size = 0; syn = 0; fin = 1
+		} else {
+			size = sizes[1 + int(rand() * 6)]; syn = 0; fin = 0
+		}
+		s = seq[f]
+		seq[f] = s + ((syn || fin) ? 1 : size)
+		sent[f]++
+		if (--left[f] == 0) alive[i] = alive[--aliveCt]
+		if (sent[f] > 1 && rand() < loss) continue
+
+		line = sprintf("%d\t%.9f\t%s\t8000\t%s\t%d\t%d\t%d\t%d\t%d\t1\t%d\t0\t%d\t%d\t1",
+				frame, t, src[f], dst[f], dport[f], size + 66, size + 52, size, syn, fin, s, fin ? 2 : 1)
+		frame++
+		# Reordering: hold a packet back and emit it after the next one
+		if (held == "" && rand() < reorder) {
+			held = line
+		} else {
+			print line
+			if (held != "") { print held; held = "" }
+		}
+	}
+	if (held != "") print held
+}
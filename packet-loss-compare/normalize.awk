@@ -0,0 +1,51 @@
+# Turns the loss report of either analyzer into sorted, comparable records:
+#   gap <src IP>:<port> <dst IP>:<port> <from seq num> <to seq num> <bytes> <time to the ms>
+#   packets <n> / bytes <n> / connections <n> / missing <n>
+# The C report is read from its -PacketLoss.txt file, the Java report from its standard output.
+# Usage: awk -f normalize.awk report | sort
+
+function conn(s,    parts) {
+	# C: "192.168.0.10/8000 to 10.0.0.6/43032"; Java: "From 192.168.0.10:8000 to 10.0.0.6:43032"
+	sub(/^From /, "", s)
+	gsub(/\//, ":", s)
+	split(s, parts, / to /)
+	return parts[1] " " parts[2]
+}
+
+/^Bytes missing from / {
+	s = $0; sub(/^Bytes missing from /, "", s); sub(/: *$/, "", s)
+	current = conn(s)
+	next
+}
+/^Missing bytes from connection / {
+	s = $0; sub(/^Missing bytes from connection /, "", s); sub(/ as follows:$/, "", s)
+	current = conn(s)
+	next
+}
+/ missing bytes between seq num [0-9]+ and seq num / {
+	# C: "<n> missing bytes between seq num <a> and seq num <b> at time <t>"
+	printf "gap %s %s %s %s %.3f\n", current, $7, $11, $1, $NF
+	next
+}
+/ missing bytes between TCP sequence numbers / {
+	# Java: "<n> missing bytes between TCP sequence numbers <a> and <b> at time <t>"
+	printf "gap %s %s %s %s %.3f\n", current, $8, $10, $1, $NF
+	next
+}
+/ missing bytes between start of connection and / {
+	# Both: "<n> missing bytes between start of connection and ... <b> ... at time <t>"
+	for (i = 1; i <= NF; i++) if ($i == "time") t = $(i + 1)
+	printf "gap %s %s %s %s %.3f\n", current, 0, $1, $1, t
+	next
+}
+/ packets checked containing a total of / {
+	print "packets " $1
+	print "bytes " $8
+	print "connections " $11
+	next
+}
+/ bytes missing from trace sequence / {
+	s = $1; sub(/^~/, "", s)
+	print "missing " s
+	next
+}